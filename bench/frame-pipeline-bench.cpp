@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Runs WPE::FramePipeline in real time against a simulated 60Hz display and
+// a renderer whose frame times vary, and prints what each pipeline depth
+// gains in displayed frames and costs in commit-to-display latency. The
+// renderer needs frameTime on average, with one frame in jitterPeriod
+// taking jitter longer, which is what an occasional main loop stall or
+// IPC hiccup looks like from the view backend.
+
+#include "frame-pipeline.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <time.h>
+
+namespace {
+
+const uint64_t refresh = 1000000000 / 60;
+
+uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void sleepUntil(uint64_t deadline)
+{
+    struct timespec ts = { static_cast<time_t>(deadline / 1000000000), static_cast<long>(deadline % 1000000000) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr))
+        continue;
+}
+
+void measure(unsigned depth, unsigned frames, uint64_t frameTime, uint64_t jitter, unsigned jitterPeriod)
+{
+    WPE::FramePipeline pipeline("frame-pipeline-bench", depth);
+    std::mt19937 random(42);
+    std::uniform_int_distribution<uint64_t> spread(0, frameTime / 4);
+
+    uint64_t start = now();
+    uint64_t nextVSync = start + refresh;
+    unsigned rendered = 0;
+    unsigned displayed = 0;
+    unsigned refreshes = 0;
+
+    // The renderer starts a frame whenever it holds a completion.
+    bool released = true;
+    uint64_t renderDone = 0;
+
+    while (refreshes < frames) {
+        if (released) {
+            released = false;
+            uint64_t cost = frameTime - frameTime / 8 + spread(random);
+            if (++rendered % jitterPeriod == 0)
+                cost += jitter;
+            renderDone = now() + cost;
+        }
+
+        if (renderDone && renderDone < nextVSync) {
+            sleepUntil(renderDone);
+            renderDone = 0;
+            released = pipeline.commit();
+            continue;
+        }
+
+        sleepUntil(nextVSync);
+        nextVSync += refresh;
+        refreshes++;
+        if (pipeline.hasPending()) {
+            displayed++;
+            released = pipeline.displayed() || released;
+        }
+    }
+
+    const auto& statistics = pipeline.statistics();
+    printf("depth %u: %u of %u refreshes showed a new frame, commit-to-display %.2fms on average, %.2fms at most\n",
+        depth, displayed, refreshes,
+        statistics.frames ? statistics.totalLatency / 1e6 / statistics.frames : 0.0, statistics.maxLatency / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    unsigned frames = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 300;
+    double frameTime = argc > 2 ? std::strtod(argv[2], nullptr) : 12;
+    double jitter = argc > 3 ? std::strtod(argv[3], nullptr) : 8;
+    unsigned jitterPeriod = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 10;
+    if (!frames || frameTime <= 0 || jitter < 0 || !jitterPeriod) {
+        fprintf(stderr, "usage: %s [refreshes] [frame time ms] [jitter ms] [jitter period]\n", argv[0]);
+        return 1;
+    }
+
+    printf("60Hz display, frames take %.1fms, one in %u takes %.1fms more\n", frameTime, jitterPeriod, jitter);
+    for (unsigned depth = 1; depth <= WPE::FramePipeline::maximumDepth; ++depth)
+        measure(depth, frames, frameTime * 1000000, jitter * 1000000, jitterPeriod);
+
+    return 0;
+}
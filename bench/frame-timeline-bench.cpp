@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures what the WPE::FrameTimeline hooks cost per event, disabled (a
+// null check) and enabled, with one and with several threads recording,
+// and how long a report over a full ring takes. It then feeds a simulated
+// 60Hz animation with a stall every jitterPeriod frames through a timeline
+// and prints its report, to show what the statistics look like. Both
+// timelines print their report again when they go away, as they do in the
+// backends.
+
+#include "frame-timeline.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// The hooks only see the pointer, so the compiler cannot tell whether the
+// timeline exists.
+WPE::FrameTimeline* volatile s_timeline;
+
+void recordEvents(unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        if (WPE::FrameTimeline* timeline = s_timeline)
+            timeline->record(WPE::FrameTimeline::Rendered);
+    }
+}
+
+double measureRecord(WPE::FrameTimeline* timeline, unsigned threads, unsigned count)
+{
+    s_timeline = timeline;
+    uint64_t start = now();
+    if (threads == 1)
+        recordEvents(count);
+    else {
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threads; ++i)
+            workers.emplace_back(recordEvents, count);
+        for (auto& worker : workers)
+            worker.join();
+    }
+    return static_cast<double>(now() - start) / count;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    unsigned count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+    unsigned jitterPeriod = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 30;
+    if (!count || !jitterPeriod) {
+        fprintf(stderr, "usage: %s [events] [stall period]\n", argv[0]);
+        return 1;
+    }
+
+    // Reports are only printed at the end, not while measuring.
+    WPE::FrameTimeline timeline("frame-timeline-bench", WPE::FrameTimeline::Rendered, 0);
+
+    printf("record, disabled: %.2fns per event\n", measureRecord(nullptr, 1, count));
+    printf("record, enabled: %.2fns per event\n", measureRecord(&timeline, 1, count));
+    printf("record, enabled, 4 threads: %.2fns per event and thread\n", measureRecord(&timeline, 4, count / 4));
+
+    const unsigned reports = 1000;
+    uint64_t start = now();
+    for (unsigned i = 0; i < reports; ++i)
+        timeline.report();
+    printf("report over %u events: %.2fus\n", WPE::FrameTimeline::capacity, (now() - start) / 1000.0 / reports);
+
+    // Timestamps after the events above, 60 frames a second with every
+    // jitterPeriod-th frame missing two refreshes. Three events per frame
+    // fit that many frames in the ring.
+    const unsigned frames = WPE::FrameTimeline::capacity / 3;
+    WPE::FrameTimeline animation("simulated 60Hz animation", WPE::FrameTimeline::FrameDisplayed, 0);
+    const uint64_t refresh = 1000000000 / 60;
+    uint64_t timestamp = now();
+    for (unsigned frame = 1; frame <= frames; ++frame) {
+        animation.record(WPE::FrameTimeline::BufferCommit, timestamp);
+        animation.record(WPE::FrameTimeline::FrameComplete, timestamp + refresh / 4);
+        timestamp += frame % jitterPeriod ? refresh : 3 * refresh;
+        animation.record(WPE::FrameTimeline::FrameDisplayed, timestamp);
+    }
+    animation.report().print("simulated 60Hz animation");
+    printf("expected: %u frames, %u missed vsyncs\n", frames, 2 * (frames / jitterPeriod));
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Counts the heap allocations performed while IPC::Host and IPC::Client
+// dispatch incoming messages, next to a copy of the former receive path
+// which allocated a buffer and GSocketControlMessage arrays per message.
+
+#include "ipc.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <gio/gunixfdmessage.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+}
+
+static std::atomic<bool> s_counting { false };
+static std::atomic<size_t> s_allocations { 0 };
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+    if (s_counting.load(std::memory_order_relaxed))
+        ++s_allocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    if (s_counting.load(std::memory_order_relaxed))
+        ++s_allocations;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size)
+{
+    if (s_counting.load(std::memory_order_relaxed))
+        ++s_allocations;
+    return __libc_realloc(pointer, size);
+}
+
+}
+
+namespace {
+
+struct Counter : public IPC::Host::Handler, public IPC::Client::Handler {
+    void handleFd(int fd) override { close(fd); }
+    void handleMessage(char*, size_t) override { ++received; }
+
+    size_t received { 0 };
+};
+
+// The receive path as it was before it became allocation-free.
+struct LegacyReceiver {
+    LegacyReceiver(Counter& counter, int fd)
+        : counter(counter)
+        , socket(g_socket_new_from_fd(fd, nullptr))
+    {
+        source = g_socket_create_source(socket, G_IO_IN, nullptr);
+        g_source_set_callback(source, reinterpret_cast<GSourceFunc>(socketCallback), this, nullptr);
+        g_source_attach(source, g_main_context_get_thread_default());
+    }
+
+    ~LegacyReceiver()
+    {
+        g_source_destroy(source);
+        g_source_unref(source);
+        g_object_unref(socket);
+    }
+
+    static gboolean socketCallback(GSocket* socket, GIOCondition, gpointer data)
+    {
+        auto& receiver = *static_cast<LegacyReceiver*>(data);
+
+        GSocketControlMessage** messages;
+        int nMessages = 0;
+        char* buffer = g_new0(char, IPC::Message::size);
+        GInputVector vector = { buffer, IPC::Message::size };
+        gssize len = g_socket_receive_message(socket, nullptr, &vector, 1,
+            &messages, &nMessages, nullptr, nullptr, nullptr);
+
+        if (nMessages > 0) {
+            for (int i = 0; i < nMessages; ++i)
+                g_object_unref(messages[i]);
+            g_free(messages);
+        }
+
+        if (len == IPC::Message::size)
+            receiver.counter.handleMessage(buffer, IPC::Message::size);
+
+        g_free(buffer);
+        return TRUE;
+    }
+
+    Counter& counter;
+    GSocket* socket;
+    GSource* source;
+};
+
+void run(const char* name, Counter& counter, int fd, size_t total, size_t burst)
+{
+    IPC::Message message;
+    message.messageCode = 0x31;
+
+    size_t sent = 0;
+    size_t allocations = 0;
+    while (sent < total) {
+        for (size_t i = 0; i < burst && sent < total; ++i, ++sent) {
+            if (write(fd, IPC::Message::data(message), IPC::Message::size) != IPC::Message::size) {
+                fprintf(stderr, "%s: failed to write a message\n", name);
+                return;
+            }
+        }
+
+        s_allocations = 0;
+        s_counting = true;
+        while (counter.received < sent)
+            g_main_context_iteration(nullptr, TRUE);
+        s_counting = false;
+        allocations += s_allocations;
+    }
+
+    printf("%-12s %8zu messages, burst %3zu: %8zu allocations, %.3f per message\n",
+        name, total, burst, allocations, static_cast<double>(allocations) / total);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t total = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    size_t burst = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16;
+    if (!total || !burst) {
+        fprintf(stderr, "usage: %s [messages] [burst]\n", argv[0]);
+        return 1;
+    }
+
+    {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1)
+            return 1;
+
+        Counter counter;
+        LegacyReceiver receiver(counter, sockets[0]);
+        run("legacy", counter, sockets[1], total, burst);
+        close(sockets[1]);
+    }
+
+    {
+        Counter counter;
+        IPC::Host host;
+        host.initialize(counter);
+        int fd = host.releaseClientFD();
+        run("IPC::Host", counter, fd, total, burst);
+        host.deinitialize();
+        close(fd);
+    }
+
+    {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1)
+            return 1;
+
+        Counter counter;
+        IPC::Client client;
+        client.initialize(counter, sockets[0]);
+        run("IPC::Client", counter, sockets[1], total, burst);
+        client.deinitialize();
+        close(sockets[1]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Measures throughput and one-way latency of IPC::Host and IPC::Client over
+// their real socketpair. The client runs on a thread with a main context of
+// its own, the host on the main thread, as the UI process does. Transport
+// options such as WPE_IPC_TRANSPORT or WPE_IPC_RECEIVE_THREAD apply as usual.
+
+#include "ipc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Codes as used by the backends: input, buffer commit, frame complete.
+const uint64_t inputCode = 0x31;
+const uint64_t bufferCommitCode = 3;
+const uint64_t frameCompleteCode = 4;
+const uint64_t descriptorCode = 5;
+
+enum class Mix { Input, Frame, Mixed, Fds };
+
+struct Options {
+    Mix mix { Mix::Mixed };
+    size_t messages { 100000 };
+    // Input messages sent per frame in the mixed mix.
+    size_t inputPerFrame { 8 };
+    // Commit and complete frames through the eventfd signals.
+    bool signals { false };
+};
+
+uint64_t now(clockid_t clock = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void stamp(IPC::Message& message, uint64_t code)
+{
+    message.messageCode = code;
+    uint64_t time = now();
+    memcpy(message.messageData, &time, sizeof(time));
+}
+
+uint64_t latency(char* data)
+{
+    uint64_t time;
+    memcpy(&time, IPC::Message::cast(data).messageData, sizeof(time));
+    return now() - time;
+}
+
+struct Latencies {
+    Latencies(size_t capacity) { samples.reserve(capacity); }
+
+    void print(const char* direction)
+    {
+        if (samples.empty())
+            return;
+
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [this](double p) {
+            return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))] / 1000.0;
+        };
+        printf("  %-14s %8zu samples  p50 %8.2fus  p99 %8.2fus  p999 %8.2fus  max %8.2fus\n",
+            direction, samples.size(), percentile(0.50), percentile(0.99), percentile(0.999), samples.back() / 1000.0);
+    }
+
+    std::vector<uint64_t> samples;
+};
+
+struct HostSide : public IPC::Host::Handler {
+    HostSide(size_t expected)
+        : expected(expected)
+        , latencies(expected)
+    {
+    }
+
+    void handleFd(int fd) override { close(fd); }
+
+    void handleFds(const int* fds, size_t count, char* data, size_t size) override
+    {
+        for (size_t i = 0; i < count; ++i)
+            close(fds[i]);
+        handleMessage(data, size);
+    }
+
+    void handleMessage(char* data, size_t) override
+    {
+        latencies.samples.push_back(latency(data));
+        ++received;
+
+        if (IPC::Message::cast(data).messageCode == bufferCommitCode) {
+            IPC::Message message;
+            stamp(message, frameCompleteCode);
+            host.sendMessage(IPC::Message::data(message), IPC::Message::size);
+        }
+    }
+
+    void handleSignal(uint64_t count) override
+    {
+        received += count;
+        host.sendSignal();
+    }
+
+    IPC::Host host;
+    size_t expected;
+    size_t received { 0 };
+    Latencies latencies;
+};
+
+struct ClientSide : public IPC::Client::Handler {
+    ClientSide(const Options& options, int fd)
+        : options(options)
+        , fd(fd)
+        , latencies(options.messages)
+        , roundTrips(options.messages)
+    {
+    }
+
+    void handleMessage(char* data, size_t) override
+    {
+        if (IPC::Message::cast(data).messageCode != frameCompleteCode)
+            return;
+
+        latencies.samples.push_back(latency(data));
+        frameCompleted = true;
+    }
+
+    void handleSignal(uint64_t) override
+    {
+        frameCompleted = true;
+    }
+
+    void sendInput()
+    {
+        IPC::Message message;
+        stamp(message, inputCode);
+        client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    }
+
+    void sendFrameAndWait()
+    {
+        frameCompleted = false;
+        uint64_t start = now();
+
+        if (!options.signals || !client.sendSignal()) {
+            IPC::Message message;
+            stamp(message, bufferCommitCode);
+            client.sendMessage(IPC::Message::data(message), IPC::Message::size);
+        }
+
+        while (!frameCompleted)
+            g_main_context_iteration(context, TRUE);
+        roundTrips.samples.push_back(now() - start);
+    }
+
+    void run()
+    {
+        int planes[2] = { eventfd(0, EFD_CLOEXEC), eventfd(0, EFD_CLOEXEC) };
+
+        for (size_t i = 0; i < options.messages; ++i) {
+            switch (options.mix) {
+            case Mix::Input:
+                sendInput();
+                // Let credits or other host messages through now and then.
+                if (!(i % 64))
+                    g_main_context_iteration(context, FALSE);
+                break;
+            case Mix::Frame:
+                sendFrameAndWait();
+                break;
+            case Mix::Mixed:
+                for (size_t j = 0; j < options.inputPerFrame; ++j)
+                    sendInput();
+                sendFrameAndWait();
+                break;
+            case Mix::Fds:
+            {
+                IPC::Message message;
+                stamp(message, descriptorCode);
+                client.sendFds(planes, 2, message);
+                break;
+            }
+            }
+        }
+
+        close(planes[0]);
+        close(planes[1]);
+    }
+
+    static gpointer threadFunction(gpointer data)
+    {
+        auto& side = *static_cast<ClientSide*>(data);
+
+        side.context = g_main_context_new();
+        g_main_context_push_thread_default(side.context);
+        side.client.initialize(side, side.fd);
+        // As the backends do, so that WPE_IPC_CORK applies to input.
+        side.client.setMessageClass(inputCode, IPC::MessageClass::Input);
+
+        side.run();
+
+        // Keep the connection up until the host has read everything.
+        while (!side.done.load()) {
+            g_main_context_iteration(side.context, FALSE);
+            g_usleep(1000);
+        }
+
+        side.client.deinitialize();
+        g_main_context_pop_thread_default(side.context);
+        g_main_context_unref(side.context);
+        return nullptr;
+    }
+
+    const Options& options;
+    int fd;
+    GMainContext* context { nullptr };
+    IPC::Client client;
+    bool frameCompleted { false };
+    std::atomic<bool> done { false };
+    Latencies latencies;
+    // From sending the commit to handling the completion.
+    Latencies roundTrips;
+};
+
+const char* mixName(Mix mix)
+{
+    switch (mix) {
+    case Mix::Input:
+        return "input";
+    case Mix::Frame:
+        return "frame";
+    case Mix::Mixed:
+        return "mixed";
+    case Mix::Fds:
+        return "fds";
+    }
+    return "";
+}
+
+bool parseMix(const char* value, Mix& mix)
+{
+    for (Mix candidate : { Mix::Input, Mix::Frame, Mix::Mixed, Mix::Fds }) {
+        if (!strcmp(value, mixName(candidate))) {
+            mix = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t expectedMessages(const Options& options)
+{
+    if (options.mix == Mix::Mixed)
+        return options.messages * (options.inputPerFrame + 1);
+    return options.messages;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument(argv[i]);
+        bool valid = false;
+        if (!argument.compare(0, 6, "--mix=")) {
+            valid = parseMix(argv[i] + 6, options.mix);
+        } else if (!argument.compare(0, 11, "--messages=")) {
+            options.messages = std::strtoul(argv[i] + 11, nullptr, 10);
+            valid = options.messages > 0;
+        } else if (!argument.compare(0, 18, "--input-per-frame=")) {
+            options.inputPerFrame = std::strtoul(argv[i] + 18, nullptr, 10);
+            valid = true;
+        } else if (argument == "--signals") {
+            options.signals = true;
+            valid = true;
+        }
+        if (valid)
+            continue;
+
+        fprintf(stderr, "usage: %s [--mix=input|frame|mixed|fds] [--messages=N] [--input-per-frame=N] [--signals]\n", argv[0]);
+        return 1;
+    }
+
+    HostSide hostSide(expectedMessages(options));
+    hostSide.host.initialize(hostSide);
+    if (options.signals)
+        hostSide.host.enableSignals();
+    ClientSide clientSide(options, hostSide.host.releaseClientFD());
+
+    uint64_t start = now();
+    uint64_t cpuStart = now(CLOCK_PROCESS_CPUTIME_ID);
+    GThread* thread = g_thread_new("ClientSide", ClientSide::threadFunction, &clientSide);
+
+    while (hostSide.received < hostSide.expected)
+        g_main_context_iteration(nullptr, TRUE);
+
+    double seconds = (now() - start) / 1e9;
+    // Both sides run in this process, so this is the cost of sending and
+    // receiving each message, including the replies.
+    double cpuPerMessage = static_cast<double>(now(CLOCK_PROCESS_CPUTIME_ID) - cpuStart) / hostSide.expected;
+    clientSide.done = true;
+    g_thread_join(thread);
+    hostSide.host.deinitialize();
+
+    printf("%s: %zu messages to the host in %.3fs, %.0f messages/s\n",
+        mixName(options.mix), hostSide.received, seconds, hostSide.received / seconds);
+    printf("  cpu %.0fns per message\n", cpuPerMessage);
+    hostSide.latencies.print("client->host");
+    clientSide.latencies.print("host->client");
+    clientSide.roundTrips.print("frame");
+    return 0;
+}
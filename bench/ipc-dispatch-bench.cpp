@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Compares the dispatch of incoming messages through IPC::MessageRegistry with
+// the switch over reinterpret_cast message data which the backends used
+// before. The message set and the traffic mix follow the Thunder view backend:
+// mostly input, one buffer commit per handful of events.
+
+#include "ipc-message.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <time.h>
+#include <vector>
+
+namespace {
+
+// Stand-ins for the wpe_input events, of the same size and layout.
+struct AxisData { uint32_t type, time; int32_t x, y; uint32_t axis; int32_t value; uint32_t modifiers; };
+struct PointerData { uint32_t type, time; int32_t x, y; uint32_t button, state, modifiers; };
+struct TouchData { uint32_t type, time; int32_t id, x, y; };
+struct KeyboardData { uint32_t time, keyCode, hardwareKeyCode; bool pressed; uint32_t modifiers; };
+
+using AxisEvent = IPC::MessageOf<0x30, AxisData>;
+using PointerEvent = IPC::MessageOf<0x31, PointerData>;
+using TouchEvent = IPC::MessageOf<0x33, TouchData>;
+using KeyboardEvent = IPC::MessageOf<0x34, KeyboardData>;
+
+struct BufferCommit {
+    static const uint64_t code = 1;
+};
+
+struct AdjustedDimensions {
+    static const uint64_t code = 3;
+
+    uint32_t width;
+    uint32_t height;
+};
+
+// Every handler folds what it is given into a checksum, so neither variant
+// can skip reading the data.
+struct Receiver {
+    void handle(const AxisEvent& event) { sum += event.data.value + event.data.x; }
+    void handle(const PointerEvent& event) { sum += event.data.x + event.data.y + event.data.state; }
+    void handle(const TouchEvent& event) { sum += event.data.id + event.data.x; }
+    void handle(const KeyboardEvent& event) { sum += event.data.keyCode + event.data.pressed; }
+    void handle(const AdjustedDimensions& dimensions) { sum += dimensions.width * dimensions.height; }
+    void handle(const BufferCommit&) { ++sum; }
+
+    uint64_t sum { 0 };
+    size_t unhandled { 0 };
+};
+
+using Messages = IPC::MessageRegistry<Receiver,
+    AxisEvent, PointerEvent, TouchEvent, KeyboardEvent, AdjustedDimensions, BufferCommit>;
+
+__attribute__((noinline)) void dispatchSwitch(Receiver& receiver, IPC::Message& message)
+{
+    switch (message.messageCode) {
+    case AxisEvent::code:
+    {
+        auto* event = reinterpret_cast<AxisData*>(std::addressof(message.messageData));
+        receiver.sum += event->value + event->x;
+        break;
+    }
+    case PointerEvent::code:
+    {
+        auto* event = reinterpret_cast<PointerData*>(std::addressof(message.messageData));
+        receiver.sum += event->x + event->y + event->state;
+        break;
+    }
+    case TouchEvent::code:
+    {
+        auto* event = reinterpret_cast<TouchData*>(std::addressof(message.messageData));
+        receiver.sum += event->id + event->x;
+        break;
+    }
+    case KeyboardEvent::code:
+    {
+        auto* event = reinterpret_cast<KeyboardData*>(std::addressof(message.messageData));
+        receiver.sum += event->keyCode + event->pressed;
+        break;
+    }
+    case AdjustedDimensions::code:
+    {
+        auto* dimensions = reinterpret_cast<AdjustedDimensions*>(std::addressof(message.messageData));
+        receiver.sum += dimensions->width * dimensions->height;
+        break;
+    }
+    case BufferCommit::code:
+        ++receiver.sum;
+        break;
+    default:
+        ++receiver.unhandled;
+    }
+}
+
+__attribute__((noinline)) void dispatchRegistry(Receiver& receiver, IPC::Message& message)
+{
+    if (!Messages::dispatch(receiver, message))
+        ++receiver.unhandled;
+}
+
+uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Draws the message types at random, in runs of the given length. Runs of one
+// defeat any branch prediction, longer runs look like a stream of pointer
+// motion or touch updates.
+std::vector<IPC::Message> traffic(size_t count, size_t run)
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> kinds(0, 15);
+    std::uniform_int_distribution<int32_t> coordinate(0, 1919);
+
+    std::vector<IPC::Message> messages(count);
+    int kind = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto& message = messages[i];
+        int32_t x = coordinate(random), y = coordinate(random);
+        if (!(i % run))
+            kind = kinds(random);
+        switch (kind) {
+        case 0: case 1: case 2: case 3: case 4: case 5: case 6: case 7:
+            IPC::encode(message, PointerEvent { { 0, 0, x, y, 0, 0, 0 } });
+            break;
+        case 8: case 9:
+            IPC::encode(message, AxisEvent { { 0, 0, x, y, 0, 120, 0 } });
+            break;
+        case 10: case 11:
+            IPC::encode(message, TouchEvent { { 0, 0, 1, x, y } });
+            break;
+        case 12: case 13:
+            IPC::encode(message, KeyboardEvent { { 0, 28, 36, true, 0 } });
+            break;
+        case 14:
+            IPC::encode(message, BufferCommit { });
+            break;
+        default:
+            // Unknown to the receiver, e.g. from a newer peer.
+            message.messageCode = 0x40;
+            break;
+        }
+    }
+    messages.back() = IPC::Message();
+    IPC::encode(messages.back(), AdjustedDimensions { 1280, 720 });
+    return messages;
+}
+
+template<typename Dispatch>
+void measure(const char* name, std::vector<IPC::Message>& messages, size_t run, size_t rounds, Dispatch dispatch)
+{
+    Receiver receiver;
+    uint64_t start = now();
+    for (size_t round = 0; round < rounds; ++round) {
+        for (auto& message : messages)
+            dispatch(receiver, message);
+    }
+    uint64_t elapsed = now() - start;
+
+    size_t total = messages.size() * rounds;
+    printf("%-10s %10zu messages, runs of %3zu: %6.2fns per message (checksum %llu, unhandled %zu)\n",
+        name, total, run, static_cast<double>(elapsed) / total,
+        static_cast<unsigned long long>(receiver.sum), receiver.unhandled);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4096;
+    size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+    if (!count || !rounds) {
+        fprintf(stderr, "usage: %s [messages] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    for (size_t run : { 1, 8, 64 }) {
+        std::vector<IPC::Message> messages = traffic(count, run);
+
+        // Twice each, the first pair warms up caches and branch predictors.
+        for (int i = 0; i < 2; ++i) {
+            measure("switch", messages, run, rounds, dispatchSwitch);
+            measure("registry", messages, run, rounds, dispatchRegistry);
+        }
+    }
+
+    return 0;
+}
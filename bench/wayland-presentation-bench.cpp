@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Commits frames on a plain shm surface and measures them with the same
+// wp_presentation feedback the Wayland display uses: the time from commit to
+// presentation and the refresh period the compositor reports. Meant to be run
+// against a throwaway compositor, for instance:
+//
+//   weston --backend=headless-backend.so --socket=wpe-presentation &
+//   WAYLAND_DISPLAY=wpe-presentation wpe-rdk-presentation-bench 300
+//
+// Exits with an error when the compositor lacks wp_presentation or never
+// presents a frame.
+
+#include "presentation-time-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <wayland-client.h>
+
+namespace {
+
+const int32_t width = 256;
+const int32_t height = 256;
+
+struct Client {
+    struct wl_display* display { nullptr };
+    struct wl_compositor* compositor { nullptr };
+    struct wl_shm* shm { nullptr };
+    struct xdg_wm_base* xdg { nullptr };
+    struct wp_presentation* presentation { nullptr };
+    uint32_t clock { CLOCK_MONOTONIC };
+
+    struct wl_surface* surface { nullptr };
+    struct wl_buffer* buffer { nullptr };
+    uint32_t* pixels { nullptr };
+    bool configured { false };
+
+    // Per frame: 0 while waiting, then the presentation time, or
+    // UINT64_MAX if the frame was discarded.
+    uint64_t presentationTime { 0 };
+    uint32_t refresh { 0 };
+};
+
+uint64_t now(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+const struct wl_registry_listener registryListener = {
+    // global
+    [](void* data, struct wl_registry* registry, uint32_t name, const char* interface, uint32_t)
+    {
+        auto& client = *static_cast<Client*>(data);
+        if (!std::strcmp(interface, wl_compositor_interface.name))
+            client.compositor = static_cast<struct wl_compositor*>(wl_registry_bind(registry, name, &wl_compositor_interface, 1));
+        else if (!std::strcmp(interface, wl_shm_interface.name))
+            client.shm = static_cast<struct wl_shm*>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
+        else if (!std::strcmp(interface, xdg_wm_base_interface.name))
+            client.xdg = static_cast<struct xdg_wm_base*>(wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+        else if (!std::strcmp(interface, wp_presentation_interface.name))
+            client.presentation = static_cast<struct wp_presentation*>(wl_registry_bind(registry, name, &wp_presentation_interface, 1));
+    },
+    // global_remove
+    [](void*, struct wl_registry*, uint32_t) { },
+};
+
+const struct wp_presentation_listener presentationListener = {
+    // clock_id
+    [](void* data, struct wp_presentation*, uint32_t clockId) { static_cast<Client*>(data)->clock = clockId; },
+};
+
+const struct xdg_wm_base_listener wmBaseListener = {
+    // ping
+    [](void*, struct xdg_wm_base* base, uint32_t serial) { xdg_wm_base_pong(base, serial); },
+};
+
+const struct xdg_surface_listener xdgSurfaceListener = {
+    // configure
+    [](void* data, struct xdg_surface* surface, uint32_t serial)
+    {
+        xdg_surface_ack_configure(surface, serial);
+        static_cast<Client*>(data)->configured = true;
+    },
+};
+
+const struct wp_presentation_feedback_listener feedbackListener = {
+    // sync_output
+    [](void*, struct wp_presentation_feedback*, struct wl_output*) { },
+    // presented
+    [](void* data, struct wp_presentation_feedback* feedback, uint32_t secondsHigh, uint32_t secondsLow, uint32_t nanoseconds, uint32_t refresh, uint32_t, uint32_t, uint32_t)
+    {
+        auto& client = *static_cast<Client*>(data);
+        uint64_t seconds = (static_cast<uint64_t>(secondsHigh) << 32) | secondsLow;
+        client.presentationTime = seconds * 1000000000 + nanoseconds;
+        client.refresh = refresh;
+        wp_presentation_feedback_destroy(feedback);
+    },
+    // discarded
+    [](void* data, struct wp_presentation_feedback* feedback)
+    {
+        static_cast<Client*>(data)->presentationTime = UINT64_MAX;
+        wp_presentation_feedback_destroy(feedback);
+    },
+};
+
+bool createBuffer(Client& client)
+{
+    size_t stride = width * 4;
+    size_t size = stride * height;
+
+    int fd = memfd_create("wpe-presentation-bench", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) < 0)
+        return false;
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    client.pixels = static_cast<uint32_t*>(data);
+
+    struct wl_shm_pool* pool = wl_shm_create_pool(client.shm, fd, size);
+    client.buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return true;
+}
+
+uint64_t percentile(std::vector<uint64_t>& values, double p)
+{
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t frames = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 120;
+    if (!frames) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    Client client;
+    client.display = wl_display_connect(nullptr);
+    if (!client.display) {
+        fprintf(stderr, "cannot connect to the Wayland display, is WAYLAND_DISPLAY set?\n");
+        return 1;
+    }
+
+    struct wl_registry* registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(registry, &registryListener, &client);
+    wl_display_roundtrip(client.display);
+
+    if (!client.compositor || !client.shm || !client.xdg) {
+        fprintf(stderr, "the compositor lacks wl_compositor, wl_shm or xdg_wm_base\n");
+        return 1;
+    }
+    if (!client.presentation) {
+        fprintf(stderr, "the compositor does not support wp_presentation\n");
+        return 1;
+    }
+
+    wp_presentation_add_listener(client.presentation, &presentationListener, &client);
+    xdg_wm_base_add_listener(client.xdg, &wmBaseListener, &client);
+
+    client.surface = wl_compositor_create_surface(client.compositor);
+    struct xdg_surface* xdgSurface = xdg_wm_base_get_xdg_surface(client.xdg, client.surface);
+    xdg_surface_add_listener(xdgSurface, &xdgSurfaceListener, &client);
+    struct xdg_toplevel* toplevel = xdg_surface_get_toplevel(xdgSurface);
+    xdg_toplevel_set_title(toplevel, "wpe-rdk-presentation-bench");
+    wl_surface_commit(client.surface);
+
+    while (!client.configured) {
+        if (wl_display_dispatch(client.display) < 0)
+            return 1;
+    }
+
+    if (!createBuffer(client)) {
+        fprintf(stderr, "cannot allocate the shm buffer\n");
+        return 1;
+    }
+
+    std::vector<uint64_t> latencies;
+    std::vector<uint64_t> intervals;
+    size_t discarded = 0;
+    uint64_t previousPresentation = 0;
+
+    for (size_t i = 0; i < frames; ++i) {
+        std::fill(client.pixels, client.pixels + width * height, 0xff000000 | (i * 0x010305));
+
+        struct wp_presentation_feedback* feedback = wp_presentation_feedback(client.presentation, client.surface);
+        wp_presentation_feedback_add_listener(feedback, &feedbackListener, &client);
+        wl_surface_attach(client.surface, client.buffer, 0, 0);
+        wl_surface_damage(client.surface, 0, 0, width, height);
+        client.presentationTime = 0;
+
+        uint64_t commitTime = now(client.clock);
+        wl_surface_commit(client.surface);
+
+        while (!client.presentationTime) {
+            if (wl_display_dispatch(client.display) < 0)
+                return 1;
+        }
+
+        if (client.presentationTime == UINT64_MAX) {
+            ++discarded;
+            continue;
+        }
+
+        latencies.push_back(client.presentationTime > commitTime ? client.presentationTime - commitTime : 0);
+        if (previousPresentation)
+            intervals.push_back(client.presentationTime - previousPresentation);
+        previousPresentation = client.presentationTime;
+    }
+
+    printf("%zu frames: %zu presented, %zu discarded, reported refresh %.3fms\n",
+        frames, latencies.size(), discarded, client.refresh / 1e6);
+    if (latencies.empty())
+        return 1;
+
+    printf("commit-to-present: p50 %.3fms, p95 %.3fms, max %.3fms\n",
+        percentile(latencies, 0.5) / 1e6, percentile(latencies, 0.95) / 1e6,
+        *std::max_element(latencies.begin(), latencies.end()) / 1e6);
+    if (!intervals.empty()) {
+        printf("present-to-present: p50 %.3fms, p95 %.3fms\n",
+            percentile(intervals, 0.5) / 1e6, percentile(intervals, 0.95) / 1e6);
+    }
+
+    wl_buffer_destroy(client.buffer);
+    xdg_toplevel_destroy(toplevel);
+    xdg_surface_destroy(xdgSurface);
+    wl_surface_destroy(client.surface);
+    wp_presentation_destroy(client.presentation);
+    wl_display_disconnect(client.display);
+    return 0;
+}
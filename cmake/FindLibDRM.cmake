@@ -0,0 +1,68 @@
+# - Try to find libdrm.
+# Once done, this will define
+#
+#  LIBDRM_FOUND - system has libdrm.
+#  LIBDRM_INCLUDE_DIRS - the libdrm include directories
+#  LIBDRM_LIBRARIES - link these to use libdrm.
+#
+# Copyright (C) 2014 Igalia S.L.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1.  Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+# 2.  Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND ITS CONTRIBUTORS ``AS
+# IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+# THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+# PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR ITS
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+# PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+# OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+# WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+# OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+if(LibDRM_FIND_QUIETLY)
+    set(_LIBDRM_MODE QUIET)
+elseif(LibDRM_FIND_REQUIRED)
+    set(_LIBDRM_MODE REQUIRED)
+endif()
+
+find_package(PkgConfig)
+pkg_check_modules(PC_LIBDRM ${_LIBDRM_MODE} libdrm)
+
+# xf86drm.h includes drm.h, which lives in a libdrm subdirectory.
+find_path(LIBDRM_INCLUDE_DIRS
+    NAMES drm.h
+    PATH_SUFFIXES libdrm
+    HINTS ${PC_LIBDRM_INCLUDEDIR} ${PC_LIBDRM_INCLUDE_DIRS}
+)
+
+find_library(LIBDRM_LIBRARIES
+    NAMES drm
+    HINTS ${PC_LIBDRM_LIBDIR} ${PC_LIBDRM_LIBRARY_DIRS}
+)
+
+mark_as_advanced(LIBDRM_INCLUDE_DIRS LIBDRM_LIBRARIES)
+
+include(FindPackageHandleStandardArgs)
+
+find_package_handle_standard_args(LibDRM
+    REQUIRED_VARS LIBDRM_INCLUDE_DIRS LIBDRM_LIBRARIES
+    FOUND_VAR LIBDRM_FOUND
+    VERSION_VAR PC_LIBDRM_VERSION)
+
+if(LibDRM_FOUND AND NOT TARGET LibDRM::LibDRM)
+    add_library(LibDRM::LibDRM UNKNOWN IMPORTED)
+    set_target_properties(LibDRM::LibDRM PROPERTIES
+            IMPORTED_LOCATION "${LIBDRM_LIBRARIES}"
+            INTERFACE_COMPILE_OPTIONS "${LIBDRM_DEFINITIONS}"
+            INTERFACE_INCLUDE_DIRECTORIES "${LIBDRM_INCLUDE_DIRS}"
+            )
+endif()
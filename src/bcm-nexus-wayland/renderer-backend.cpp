@@ -27,8 +27,10 @@
 
 #include <wpe/wpe-egl.h>
 
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-bcmnexuswl.h"
+#include "ipc-message.h"
 #include <EGL/egl.h>
 #include <cstring>
 #include <refsw/nexus_config.h>
@@ -49,12 +51,11 @@ struct Backend {
     ~Backend();
 
     bool authenticated() const { return m_authenticated; }
-    void authenticate(uint32_t, uint32_t, uint8_t*);
+    void authenticate(const char*, size_t);
     void waitForAuthenticationIfNeeded();
 
     NXPL_PlatformHandle m_nxplHandle { nullptr };
     NxClient_AllocResults m_allocResults;
-    std::string m_authenticationData { };
 
     std::mutex m_authenticationMutex;
     std::condition_variable m_authenticationCondition;
@@ -98,20 +99,20 @@ void Backend::waitForAuthenticationIfNeeded()
         m_authenticationCondition.wait(locker);
 }
 
-void Backend::authenticate(uint32_t authDataSize, uint32_t chunkSize, uint8_t* authData)
+void Backend::authenticate(const char* authData, size_t authDataSize)
 {
-    m_authenticationData.append(reinterpret_cast<const char*>(authData), chunkSize);
-    if (m_authenticationData.length() != authDataSize)
-        return;
-
     // Unregister to register again
     NXPL_UnregisterNexusDisplayPlatform(m_nxplHandle);
     NxClient_Free(&m_allocResults);
     NxClient_Uninit();
 
     NEXUS_Certificate certificate;
-    BKNI_Memcpy(certificate.data, m_authenticationData.data(), m_authenticationData.length());
-    certificate.length = m_authenticationData.length();
+    if (authDataSize > sizeof(certificate.data)) {
+        fprintf(stderr, "Backend: authentication data too large\n");
+        authDataSize = sizeof(certificate.data);
+    }
+    BKNI_Memcpy(certificate.data, authData, authDataSize);
+    certificate.length = authDataSize;
 
     NEXUS_ClientAuthenticationSettings authSettings;
     NEXUS_Platform_GetDefaultClientAuthenticationSettings(&authSettings);
@@ -135,6 +136,10 @@ struct EGLTarget : public IPC::Client::Handler {
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
 
+    // IPC messages; Authentication comes with a payload and is handled apart.
+    void handle(const IPC::BCMNexusWL::TargetConstruction&);
+    void handle(const IPC::BCMNexusWL::FrameComplete&);
+
     void constructTarget(uint32_t, uint32_t, uint32_t);
 
     struct wpe_renderer_backend_egl_target* target;
@@ -144,8 +149,12 @@ struct EGLTarget : public IPC::Client::Handler {
     Backend* m_backend { nullptr };
     uint32_t m_width { 0 };
     uint32_t m_height { 0 };
+
+    std::unique_ptr<WPE::FrameTimeline> m_timeline { WPE::FrameTimeline::create("BCMNexusWL::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::BCMNexusWL::TargetConstruction, IPC::BCMNexusWL::FrameComplete>;
+
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     : target(target)
 {
@@ -169,31 +178,32 @@ void EGLTarget::initialize(Backend& backend)
 
 void EGLTarget::handleMessage(char* data, size_t size)
 {
-    if (size != IPC::Message::size)
+    if (size < IPC::Message::size)
         return;
 
     auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::BCMNexusWL::TargetConstruction::code:
-    {
-        auto& targetConstruction = IPC::BCMNexusWL::TargetConstruction::cast(message);
-        constructTarget(targetConstruction.handle, targetConstruction.width, targetConstruction.height);
-        break;
-    }
-    case IPC::BCMNexusWL::Authentication::code:
-    {
-        auto& authentication = IPC::BCMNexusWL::Authentication::cast(message);
-        m_backend->authenticate(authentication.authDataSize, authentication.chunkSize, authentication.data);
-        break;
-    }
-    case IPC::BCMNexusWL::FrameComplete::code:
-    {
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-        break;
+    if (message.messageCode == IPC::BCMNexusWL::Authentication::code) {
+        m_backend->authenticate(IPC::Message::payload(data), size - IPC::Message::size);
+        return;
     }
-    default:
+
+    if (size != IPC::Message::size)
+        return;
+
+    if (!EGLTargetMessages::dispatch(*this, message))
         fprintf(stderr, "EGLTarget: unhandled message\n");
-    };
+}
+
+void EGLTarget::handle(const IPC::BCMNexusWL::TargetConstruction& targetConstruction)
+{
+    constructTarget(targetConstruction.handle, targetConstruction.width, targetConstruction.height);
+}
+
+void EGLTarget::handle(const IPC::BCMNexusWL::FrameComplete&)
+{
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 void EGLTarget::constructTarget(uint32_t handle, uint32_t width, uint32_t height)
@@ -267,14 +277,19 @@ struct wpe_renderer_backend_egl_target_interface bcm_nexus_wayland_renderer_back
     // frame_will_render
     [](void* data)
     {
+        auto& target = *static_cast<BCMNexusWL::EGLTarget*>(data);
+        if (target.m_timeline)
+            target.m_timeline->record(WPE::FrameTimeline::WillRender);
     },
     // frame_rendered
     [](void* data)
     {
         auto& target = *static_cast<BCMNexusWL::EGLTarget*>(data);
+        if (target.m_timeline)
+            target.m_timeline->record(WPE::FrameTimeline::Rendered);
 
         IPC::Message message;
-        IPC::BCMNexusWL::BufferCommit::construct(message, target.m_width, target.m_height);
+        IPC::encode(message, IPC::BCMNexusWL::BufferCommit { target.m_width, target.m_height });
         target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
     },
 };
@@ -28,8 +28,10 @@
 #include <wpe/wpe.h>
 
 #include "display.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-bcmnexuswl.h"
+#include "ipc-message.h"
 #include "xdg-shell-client-protocol.h"
 #include "nsc-client-protocol.h"
 #include <algorithm>
@@ -51,6 +53,9 @@ public:
     void handleMessage(char*, size_t) override;
     void commitBuffer(uint32_t, uint32_t);
 
+    // IPC messages
+    void handle(const IPC::BCMNexusWL::BufferCommit& commit) { commitBuffer(commit.width, commit.height); }
+
     struct wpe_view_backend* backend() { return m_backend; }
     IPC::Host& ipcHost() { return m_ipcHost; }
 
@@ -58,6 +63,7 @@ public:
         IPC::Host* ipcHost;
         struct wl_callback* frameCallback;
         struct wpe_view_backend* backend;
+        WPE::FrameTimeline* timeline;
     };
 
     struct NSCData {
@@ -74,11 +80,13 @@ private:
     struct wl_surface* m_surface;
     struct xdg_surface* m_xdgSurface;
 
-    CallbackListenerData m_callbackData { nullptr, nullptr, nullptr};
+    CallbackListenerData m_callbackData { nullptr, nullptr, nullptr, nullptr };
     NSCData m_nscData { 0, std::string{ }, 0, 0 };
     struct wl_buffer* m_buffer;
 
     IPC::Host m_ipcHost;
+
+    std::unique_ptr<WPE::FrameTimeline> m_timeline { WPE::FrameTimeline::create("BCMNexusWL::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
 };
 
 static const struct xdg_surface_listener g_xdgSurfaceListener = {
@@ -99,10 +107,14 @@ const struct wl_callback_listener g_callbackListener = {
 
         if (callbackData.ipcHost) {
             IPC::Message message;
-            IPC::BCMNexusWL::FrameComplete::construct(message);
+            IPC::encode(message, IPC::BCMNexusWL::FrameComplete { });
             callbackData.ipcHost->sendMessage(IPC::Message::data(message), IPC::Message::size);
+            if (callbackData.timeline)
+                callbackData.timeline->record(WPE::FrameTimeline::FrameComplete);
         }
 
+        if (callbackData.timeline)
+            callbackData.timeline->record(WPE::FrameTimeline::FrameDisplayed);
         wpe_view_backend_dispatch_frame_displayed(callbackData.backend);
 
         callbackData.frameCallback = nullptr;
@@ -146,6 +158,8 @@ static const struct wl_nsc_listener g_nscListener = {
     [](void*, struct wl_nsc*, struct wl_array*) { },
 };
 
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend, IPC::BCMNexusWL::BufferCommit>;
+
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : m_display(Wayland::Display::singleton())
     , m_backend(backend)
@@ -164,6 +178,7 @@ ViewBackend::ViewBackend(struct wpe_view_backend* backend)
 
     m_callbackData.ipcHost = &m_ipcHost;
     m_callbackData.backend = m_backend;
+    m_callbackData.timeline = m_timeline.get();
 }
 
 ViewBackend::~ViewBackend()
@@ -176,7 +191,7 @@ ViewBackend::~ViewBackend()
 
     if (m_callbackData.frameCallback)
         wl_callback_destroy(m_callbackData.frameCallback);
-    m_callbackData = { nullptr, nullptr, nullptr };
+    m_callbackData = { nullptr, nullptr, nullptr, nullptr };
 
     m_nscData = { 0, std::string{ }, 0, 0 };
 
@@ -201,22 +216,8 @@ void ViewBackend::initialize()
     wl_display_roundtrip(m_display.display());
 
     IPC::Message message;
-
-    size_t transferredData = 0;
-    size_t totalDataSize = m_nscData.authenticationData.length();
-    const uint8_t* data = reinterpret_cast<const uint8_t*>(m_nscData.authenticationData.data());
-    while (transferredData < totalDataSize) {
-        size_t dataSize;
-        if (totalDataSize - transferredData > IPC::BCMNexusWL::Authentication::maxChunkSize)
-            dataSize = IPC::BCMNexusWL::Authentication::maxChunkSize;
-        else
-            dataSize = totalDataSize - transferredData;
-
-        IPC::BCMNexusWL::Authentication::construct(message, totalDataSize, dataSize, data + transferredData);
-        m_ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
-
-        transferredData += dataSize;
-    }
+    IPC::encode(message, IPC::BCMNexusWL::Authentication { });
+    m_ipcHost.sendMessage(message, m_nscData.authenticationData.data(), m_nscData.authenticationData.length());
 
     wl_nsc_request_clientID(m_display.interfaces().nsc, WL_NSC_CLIENT_SURFACE);
     wl_display_roundtrip(m_display.display());
@@ -224,7 +225,7 @@ void ViewBackend::initialize()
     wl_nsc_create_window(m_display.interfaces().nsc, m_nscData.clientID, 0, m_nscData.width, m_nscData.height);
     wl_display_roundtrip(m_display.display());
 
-    IPC::BCMNexusWL::TargetConstruction::construct(message, m_nscData.clientID, m_nscData.width, m_nscData.height);
+    IPC::encode(message, IPC::BCMNexusWL::TargetConstruction { m_nscData.clientID, m_nscData.width, m_nscData.height });
     m_ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
 
 }
@@ -234,21 +235,15 @@ void ViewBackend::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::BCMNexusWL::BufferCommit::code:
-    {
-        auto& bufferCommit = IPC::BCMNexusWL::BufferCommit::cast(message);
-        commitBuffer(bufferCommit.width, bufferCommit.height);
-        break;
-    }
-    default:
+    if (!ViewBackendMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "ViewBackend: unhandled message\n");
-    }
 }
 
 void ViewBackend::commitBuffer(uint32_t width, uint32_t height)
 {
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::BufferCommit);
+
     if (width != m_nscData.width || height != m_nscData.height)
         return;
 
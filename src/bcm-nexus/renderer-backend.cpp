@@ -27,8 +27,10 @@
 
 #include <wpe/wpe-egl.h>
 
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-bcmnexus.h"
+#include "ipc-message.h"
 #include <EGL/egl.h>
 #include <cstring>
 #include <stdio.h>
@@ -154,14 +156,21 @@ struct EGLTarget : public IPC::Client::Handler {
     // IPC::Client::Handler
     void handleMessage(char*, size_t) override;
 
+    // IPC messages
+    void handle(const IPC::BCMNexus::FrameComplete&);
+
     struct wpe_renderer_backend_egl_target* target;
     IPC::Client ipcClient;
 
     void* nativeWindow;
     uint32_t width { 0 };
     uint32_t height { 0 };
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("BCMNexus::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::BCMNexus::FrameComplete>;
+
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     : target(target)
     , nativeWindow(nullptr)
@@ -206,16 +215,15 @@ void EGLTarget::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::BCMNexus::FrameComplete::code:
-    {
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-        break;
-    }
-    default:
+    if (!EGLTargetMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "EGLTarget: unhandled message\n");
-    };
+}
+
+void EGLTarget::handle(const IPC::BCMNexus::FrameComplete&)
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 } // namespace BCMNexus
@@ -272,14 +280,19 @@ struct wpe_renderer_backend_egl_target_interface bcm_nexus_renderer_backend_egl_
     // frame_will_render
     [](void* data)
     {
+        auto& target = *static_cast<BCMNexus::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::WillRender);
     },
     // frame_rendered
     [](void* data)
     {
         auto& target = *static_cast<BCMNexus::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::Rendered);
 
         IPC::Message message;
-        IPC::BCMNexus::BufferCommit::construct(message, target.width, target.height);
+        IPC::encode(message, IPC::BCMNexus::BufferCommit { target.width, target.height });
         target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
     },
 };
@@ -37,8 +37,10 @@
 #include <wayland-client.h>
 #endif
 
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-bcmnexus.h"
+#include "ipc-message.h"
 #include <algorithm>
 #include <array>
 #include <cassert>
@@ -104,6 +106,9 @@ struct ViewBackend : public IPC::Host::Handler
 
     void commitBuffer(uint32_t, uint32_t);
 
+    // IPC messages
+    void handle(const IPC::BCMNexus::BufferCommit& commit) { commitBuffer(commit.width, commit.height); }
+
 #ifdef KEY_INPUT_HANDLING_LIBINPUT
     // WPE::LibinputServer::Client
     void handleKeyboardEvent(struct wpe_input_keyboard_event*) override;
@@ -125,8 +130,12 @@ struct ViewBackend : public IPC::Host::Handler
 
     uint32_t width { 0 };
     uint32_t height { 0 };
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("BCMNexus::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
 };
 
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend, IPC::BCMNexus::BufferCommit>;
+
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : backend(backend)
 #ifdef KEY_INPUT_HANDLING_WAYLAND
@@ -200,6 +209,10 @@ void ViewBackend::initialize()
             [](void*, struct xdg_toplevel*, int32_t, int32_t, struct wl_array*) {},
             // close
             [](void*, struct xdg_toplevel*) {},
+            // configure_bounds
+            [](void*, struct xdg_toplevel*, int32_t, int32_t) {},
+            // wm_capabilities
+            [](void*, struct xdg_toplevel*, struct wl_array*) {},
         };
         xdg_toplevel_add_listener(m_xdgTopLevel, &topLevelListener, nullptr);
         xdg_toplevel_set_app_id(m_xdgTopLevel, "com.rdkcentral.WPEBackend");
@@ -227,28 +240,26 @@ void ViewBackend::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::BCMNexus::BufferCommit::code:
-    {
-        auto& bufferCommit = IPC::BCMNexus::BufferCommit::cast(message);
-        commitBuffer(bufferCommit.width, bufferCommit.height);
-        break;
-    }
-    default:
+    if (!ViewBackendMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "ViewBackend: unhandled message\n");
-    }
 }
 
 void ViewBackend::commitBuffer(uint32_t width, uint32_t height)
 {
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::BufferCommit);
+
     if (width != this->width || height != this->height)
         return;
 
     IPC::Message message;
-    IPC::BCMNexus::FrameComplete::construct(message);
+    IPC::encode(message, IPC::BCMNexus::FrameComplete { });
     ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
 
+    if (timeline) {
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+        timeline->record(WPE::FrameTimeline::FrameDisplayed);
+    }
     wpe_view_backend_dispatch_frame_displayed(backend);
 }
 
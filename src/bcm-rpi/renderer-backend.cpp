@@ -27,8 +27,10 @@
 
 #include <wpe/wpe-egl.h>
 
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-rpi.h"
+#include "ipc-message.h"
 #include <EGL/egl.h>
 
 #include <cstdio>
@@ -41,6 +43,11 @@ struct EGLTarget : public IPC::Client::Handler {
 
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
+    void handleSignal(uint64_t) override;
+
+    // IPC messages
+    void handle(const IPC::BCMRPi::TargetConstruction&);
+    void handle(const IPC::BCMRPi::FrameComplete&);
 
     void constructTarget(uint32_t, uint32_t, uint32_t);
 
@@ -48,8 +55,13 @@ struct EGLTarget : public IPC::Client::Handler {
     IPC::Client ipcClient;
 
     EGL_DISPMANX_WINDOW_T nativeWindow { 0, };
+    uint32_t frameSequence { 0 };
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("BCMRPi::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::BCMRPi::TargetConstruction, IPC::BCMRPi::FrameComplete>;
+
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     : target(target)
 {
@@ -70,22 +82,26 @@ void EGLTarget::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::BCMRPi::TargetConstruction::code:
-    {
-        auto& targetConstruction = IPC::BCMRPi::TargetConstruction::cast(message);
-        constructTarget(targetConstruction.handle, targetConstruction.width, targetConstruction.height);
-        break;
-    }
-    case IPC::BCMRPi::FrameComplete::code:
-    {
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-        break;
-    }
-    default:
+    if (!EGLTargetMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "EGLTarget: unhandled message\n");
-    };
+}
+
+// FrameComplete, once the host signals it through an eventfd.
+void EGLTarget::handleSignal(uint64_t)
+{
+    handle(IPC::BCMRPi::FrameComplete { });
+}
+
+void EGLTarget::handle(const IPC::BCMRPi::TargetConstruction& targetConstruction)
+{
+    constructTarget(targetConstruction.handle, targetConstruction.width, targetConstruction.height);
+}
+
+void EGLTarget::handle(const IPC::BCMRPi::FrameComplete&)
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 void EGLTarget::constructTarget(uint32_t handle, uint32_t width, uint32_t height)
@@ -148,15 +164,20 @@ struct wpe_renderer_backend_egl_target_interface bcm_rpi_renderer_backend_egl_ta
     // frame_will_render
     [](void* data)
     {
+        auto& target = *static_cast<BCMRPi::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::WillRender);
     },
     // frame_rendered
     [](void* data)
     {
         auto& target = *static_cast<BCMRPi::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::Rendered);
 
         IPC::Message message;
-        IPC::BCMRPi::BufferCommit::construct(message, target.nativeWindow.element,
-            target.nativeWindow.width, target.nativeWindow.height);
+        IPC::encode(message, IPC::BCMRPi::BufferCommit { target.nativeWindow.element,
+            static_cast<uint32_t>(target.nativeWindow.width), static_cast<uint32_t>(target.nativeWindow.height), ++target.frameSequence });
         target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
     },
 };
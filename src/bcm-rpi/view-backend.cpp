@@ -29,13 +29,16 @@
 
 #include "Libinput/LibinputServer.h"
 #include "cursor-data.h"
+#include "frame-pipeline.h"
+#include "frame-throttle.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-rpi.h"
+#include "ipc-message.h"
 #include <bcm_host.h>
 #include <cstdio>
 #include <memory>
 #include <sys/eventfd.h>
-#include <sys/time.h>
 
 namespace BCMRPi {
 
@@ -64,8 +67,12 @@ struct ViewBackend : public IPC::Host::Handler, public WPE::LibinputServer::Clie
     void handleFd(int) override;
     void handleMessage(char*, size_t) override;
 
-    void commitBuffer(uint32_t, uint32_t, uint32_t);
+    void commitBuffer(uint32_t, uint32_t, uint32_t, uint32_t);
     void handleUpdate();
+    void releaseFrame();
+
+    // IPC messages
+    void handle(const IPC::BCMRPi::BufferCommit& commit) { commitBuffer(commit.handle, commit.width, commit.height, commit.sequence); }
 
     // WPE::LibinputServer::Client
     void handleKeyboardEvent(struct wpe_input_keyboard_event*) override;
@@ -79,8 +86,14 @@ struct ViewBackend : public IPC::Host::Handler, public WPE::LibinputServer::Clie
     DISPMANX_DISPLAY_HANDLE_T displayHandle { DISPMANX_NO_HANDLE };
     DISPMANX_ELEMENT_HANDLE_T elementHandle { DISPMANX_NO_HANDLE };
 
+    // Counts completed dispmanx updates, each displays the oldest frame
+    // of the pipeline.
     int updateFd { -1 };
     GSource* updateSource;
+    WPE::FramePipeline pipeline { "BCMRPi::ViewBackend" };
+    // Holds FrameComplete back while the view is hidden.
+    WPE::FrameThrottle throttle { backend, "BCMRPi::ViewBackend", [](void* data) { static_cast<ViewBackend*>(data)->releaseFrame(); }, this };
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("BCMRPi::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
 
     uint32_t width { 0 };
     uint32_t height { 0 };
@@ -106,10 +119,14 @@ struct ViewBackend : public IPC::Host::Handler, public WPE::LibinputServer::Clie
     std::unique_ptr<Cursor> cursor;
 };
 
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend, IPC::BCMRPi::BufferCommit>;
+
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : backend(backend)
 {
     ipcHost.initialize(*this);
+    // Only FrameComplete is signalled, BufferCommit carries data.
+    ipcHost.enableSignals();
 
     bcm_host_init();
     displayHandle = vc_dispmanx_display_open(0);
@@ -203,7 +220,7 @@ void ViewBackend::initializeInput()
 int ViewBackend::releaseClientFD()
 {
     IPC::Message message;
-    IPC::BCMRPi::TargetConstruction::construct(message, elementHandle, width, height);
+    IPC::encode(message, IPC::BCMRPi::TargetConstruction { elementHandle, width, height });
     ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
 
     return ipcHost.releaseClientFD();
@@ -218,24 +235,21 @@ void ViewBackend::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::BCMRPi::BufferCommit::code:
-    {
-        auto& bufferCommit = IPC::BCMRPi::BufferCommit::cast(message);
-        commitBuffer(bufferCommit.handle, bufferCommit.width, bufferCommit.height);
-        break;
-    }
-    default:
+    if (!ViewBackendMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "ViewBackend: unhandled message\n");
-    }
 }
 
-void ViewBackend::commitBuffer(uint32_t handle, uint32_t width, uint32_t height)
+void ViewBackend::commitBuffer(uint32_t handle, uint32_t width, uint32_t height, uint32_t sequence)
 {
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::BufferCommit);
+
     if (handle != elementHandle || width != this->width || height != this->height)
         return;
 
+    if (pipeline.commit(sequence))
+        throttle.release();
+
     DISPMANX_UPDATE_HANDLE_T updateHandle = vc_dispmanx_update_start(0);
 
     VC_RECT_T srcRect, destRect;
@@ -249,12 +263,9 @@ void ViewBackend::commitBuffer(uint32_t handle, uint32_t width, uint32_t height)
         {
             auto& backend = *static_cast<ViewBackend*>(data);
 
-            struct timeval tv;
-            gettimeofday(&tv, nullptr);
-            uint64_t time = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-
-            ssize_t ret = write(backend.updateFd, &time, sizeof(time));
-            if (ret != sizeof(time))
+            uint64_t count = 1;
+            ssize_t ret = write(backend.updateFd, &count, sizeof(count));
+            if (ret != sizeof(count))
                 fprintf(stderr, "ViewBackend: failed to write to the update eventfd\n");
         },
         this);
@@ -262,16 +273,31 @@ void ViewBackend::commitBuffer(uint32_t handle, uint32_t width, uint32_t height)
 
 void ViewBackend::handleUpdate()
 {
-    uint64_t time;
-    ssize_t ret = read(updateFd, &time, sizeof(time));
-    if (ret != sizeof(time))
+    // With several frames in flight, updates may complete between two reads.
+    uint64_t count;
+    ssize_t ret = read(updateFd, &count, sizeof(count));
+    if (ret != sizeof(count))
         return;
 
-    IPC::Message message;
-    IPC::BCMRPi::FrameComplete::construct(message);
-    ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    for (; count; --count) {
+        if (pipeline.displayed())
+            throttle.release();
+        if (timeline)
+            timeline->record(WPE::FrameTimeline::FrameDisplayed);
+        wpe_view_backend_dispatch_frame_displayed(backend);
+    }
+}
 
-    wpe_view_backend_dispatch_frame_displayed(backend);
+void ViewBackend::releaseFrame()
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+
+    if (!ipcHost.sendSignal()) {
+        IPC::Message message;
+        IPC::encode(message, IPC::BCMRPi::FrameComplete { });
+        ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    }
 }
 
 void ViewBackend::handleKeyboardEvent(struct wpe_input_keyboard_event* event)
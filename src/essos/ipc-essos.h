@@ -19,8 +19,9 @@
 #ifndef wpe_platform_ipc_essos_h
 #define wpe_platform_ipc_essos_h
 
-#include <memory>
+#include "ipc-message.h"
 #include <stdint.h>
+#include <wpe/wpe.h>
 
 namespace IPC
 {
@@ -35,29 +36,32 @@ enum MsgType
     TOUCHSIMPLE,
     KEYBOARD,
     FRAMERENDERED,
-    DISPLAYSIZE
+    DISPLAYSIZE,
+    VISIBILITY
+};
+
+using AxisEvent = MessageOf<MsgType::AXIS, wpe_input_axis_event>;
+using PointerEvent = MessageOf<MsgType::POINTER, wpe_input_pointer_event>;
+using TouchSimpleEvent = MessageOf<MsgType::TOUCHSIMPLE, wpe_input_touch_event_raw>;
+using KeyboardEvent = MessageOf<MsgType::KEYBOARD, wpe_input_keyboard_event>;
+
+struct FrameRendered {
+    static const uint64_t code = MsgType::FRAMERENDERED;
 };
 
 struct DisplaySize {
+    static const uint64_t code = MsgType::DISPLAYSIZE;
+
     uint32_t width;
     uint32_t height;
-    uint8_t padding[24];
+};
 
-    static const uint64_t code = MsgType::DISPLAYSIZE;
-    static void construct(Message& message, uint32_t width, uint32_t height)
-    {
-        message.messageCode = code;
+// The view was shown or hidden, the renderer trims its window while hidden.
+struct Visibility {
+    static const uint64_t code = MsgType::VISIBILITY;
 
-        auto& messageData = *reinterpret_cast<DisplaySize*>(std::addressof(message.messageData));
-        messageData.width = width;
-        messageData.height = height;
-    }
-    static DisplaySize& cast(Message& message)
-    {
-        return *reinterpret_cast<DisplaySize*>(std::addressof(message.messageData));
-    }
+    uint32_t visible;
 };
-static_assert(sizeof(DisplaySize) == Message::dataSize, "DisplaySize is of correct size");
 
 }  // namespace Essos
 
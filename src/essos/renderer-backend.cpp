@@ -23,26 +23,31 @@
 #include <stdlib.h>
 #include <cstdio>
 #include <utility>
+#include <algorithm>
 #include <clocale>
 
 #include <linux/input.h>
 #include <essos-app.h>
 #include <essos-system.h>
+#include <wayland-client.h>
+#if HAVE_WAYLAND_EGL_BACKEND
+#include <wayland-egl-backend.h>
+#endif
 #include <xkbcommon/xkbcommon.h>
 #include <xkbcommon/xkbcommon-compose.h>
 
+#include "frame-throttle.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-essos.h"
+#include "ipc-flow-policy.h"
+#include "statistics.h"
+#include "surface-trim.h"
 
 #define ERROR_LOG(fmt, ...) fprintf(stderr, "[essos:renderer-backend.cpp:%u:%s] *** " fmt "\n", __LINE__, __func__, ##__VA_ARGS__)
 #define WARN_LOG(fmt, ...)  fprintf(stderr, "[essos:renderer-backend.cpp:%u:%s] Warning: " fmt "\n", __LINE__, __func__, ##__VA_ARGS__)
 #define DEBUG_LOG(fmt, ...) if (enableDebugLogs()) fprintf(stderr, "[essos:renderer-backend.cpp:%u:%s] " fmt "\n", __LINE__, __func__, ##__VA_ARGS__)
 
-extern "C" {
-struct wl_display;
-int wl_display_flush (struct wl_display *display);
-}
-
 namespace Essos {
 
 static bool enableDebugLogs()
@@ -137,16 +142,27 @@ struct EGLTarget : public IPC::Client::Handler
     void initialize(Backend& backend, uint32_t width, uint32_t height);
     void deinitialize();
 
+    void createEventSource();
+    void attachTimerSource(gint64 interval);
     gboolean runEventLoopOnce();
+    int pendingTimeout() const;
     void stop();
 
     EGLNativeWindowType getNativeWindow() const;
     void resize(uint32_t width, uint32_t height);
+    void resizeWindow(uint32_t width, uint32_t height);
+    void frameWillRender();
     void frameRendered();
+    void frameDisplayed();
+    void sendFrameRendered();
 
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
 
+    // IPC messages
+    void handle(const IPC::Essos::Visibility& message) { setVisible(message.visible); }
+    void setVisible(bool);
+
     // Essos event listeners
     bool updateKeyModifiers(unsigned int key, bool pressed);
     bool updateButtonModifiers(unsigned int button, bool pressed);
@@ -167,6 +183,7 @@ struct EGLTarget : public IPC::Client::Handler
     static EssPointerListener pointerListener;
     static EssTouchListener touchListener;
     static EssTerminateListener terminateListener;
+    static const struct wl_callback_listener frameListener;
 
     IPC::Client ipcClient;
 
@@ -175,12 +192,55 @@ struct EGLTarget : public IPC::Client::Handler
     EssCtx *essosCtx { nullptr };
     GSource *eventSource { nullptr };
 
+    // In Wayland mode frames complete when the compositor's frame callback
+    // for the Essos surface fires. Without access to the surface, and in
+    // direct mode, completion falls back to the event loop pacing below.
+    struct wl_surface* surface { nullptr };
+    struct wl_callback* frameCallback { nullptr };
+    gint64 frameRenderedTime { 0 };
+
+    struct LatencyStatistics {
+        void print() const;
+
+        uint64_t frames { 0 };
+        uint64_t totalTime { 0 };
+        uint64_t maxTime { 0 };
+    } latencyStatistics;
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("Essos::EGLTarget", WPE::FrameTimeline::Rendered) };
+
+    // Shrinks the native window while the view is hidden.
+    WPE::SurfaceTrim surfaceTrim { "Essos::EGLTarget", [](void* data, uint32_t width, uint32_t height) { static_cast<EGLTarget*>(data)->resizeWindow(width, height); }, this };
+
     NativeWindowType nativeWindow { 0 };
     int pageWidth { 0 };
     int pageHeight { 0 };
     uint32_t inputModifiers { 0 };
     uint32_t shouldDispatchFrameComplete { 0 };
 
+    // The key Essos repeats, 0 if none, and when it was pressed or last
+    // repeated. Essos repeats from within its event loop, which has to run
+    // every cycle meanwhile. The release may never arrive, e.g. when the
+    // keyboard focus moved away, so the state also ends when no repeat
+    // followed for keyRepeatTimeout, and when the view is hidden.
+    unsigned int repeatKey { 0 };
+    gint64 repeatTime { 0 };
+    static const gint64 keyRepeatTimeout = G_USEC_PER_SEC;
+    void setKeyRepeat(unsigned int key) { repeatKey = key; repeatTime = g_get_monotonic_time(); }
+    bool keyRepeating(gint64 now) const { return repeatKey && visible && now - repeatTime < keyRepeatTimeout; }
+
+    // Event loop pacing, in microseconds. The frame interval is only used
+    // when the loop is driven by the display fd, in timer mode each cycle
+    // completes at most one frame.
+    gint64 cycleInterval { 0 };
+    gint64 frameInterval { 0 };
+    bool timerLoop { false };
+    // While the view process reports the view hidden, frames complete at
+    // WPE_HIDDEN_FRAME_RATE, see WPE::FrameThrottle, and keys do not repeat.
+    bool visible { true };
+    gint64 nextFrameCompleteTime { 0 };
+    gint64 lastCycleTime { 0 };
+
     xkb_mod_mask_t modShiftMask;
     xkb_mod_mask_t modAltMask;
     xkb_mod_mask_t modCtrlMask;
@@ -196,11 +256,27 @@ EssSettingsListener EGLTarget::settingsListener = {
 
 EssKeyListener EGLTarget::keyListener = {
     // keyPressed
-    [](void* data, unsigned int key) { reinterpret_cast<EGLTarget*>(data)->onKeyEvent(key, true); },
+    [](void* data, unsigned int key)
+    {
+        auto& self = *reinterpret_cast<EGLTarget*>(data);
+        self.setKeyRepeat(key);
+        self.onKeyEvent(key, true);
+    },
     // keyReleased
-    [](void* data, unsigned int key) { reinterpret_cast<EGLTarget*>(data)->onKeyEvent(key, false); },
+    [](void* data, unsigned int key)
+    {
+        auto& self = *reinterpret_cast<EGLTarget*>(data);
+        if (key == self.repeatKey)
+            self.repeatKey = 0;
+        self.onKeyEvent(key, false);
+    },
     // keyRepeat
-    [](void* data, unsigned int key) { reinterpret_cast<EGLTarget*>(data)->onKeyRepeat(key); },
+    [](void* data, unsigned int key)
+    {
+        auto& self = *reinterpret_cast<EGLTarget*>(data);
+        self.setKeyRepeat(key);
+        self.onKeyRepeat(key);
+    },
 };
 
 EssPointerListener EGLTarget::pointerListener = {
@@ -228,15 +304,119 @@ EssTerminateListener EGLTarget::terminateListener = {
     []( void *data ) { reinterpret_cast<EGLTarget*>(data)->onTerminated(); },
 };
 
+const struct wl_callback_listener EGLTarget::frameListener = {
+    // done
+    [](void* data, struct wl_callback* callback, uint32_t)
+    {
+        auto& self = *reinterpret_cast<EGLTarget*>(data);
+        if (self.frameCallback == callback)
+            self.frameDisplayed();
+    },
+};
+
+// Drives the Essos event loop from the Wayland display fd: the loop runs
+// when the compositor sent something, when a frame completion is due, and
+// at the cycle rate while a key is held so Essos can generate key repeats.
+struct EventSource
+{
+    static GSourceFuncs sourceFuncs;
+
+    GSource source;
+    GPollFD pfd;
+    struct wl_display* display;
+    EGLTarget* target;
+    bool isReading;
+};
+
+GSourceFuncs EventSource::sourceFuncs = {
+    // prepare
+    [](GSource* base, gint* timeout) -> gboolean
+    {
+        auto& source = *reinterpret_cast<EventSource*>(base);
+
+        *timeout = -1;
+
+        if (source.isReading)
+            return FALSE;
+
+        int pending = source.target->pendingTimeout();
+        if (pending == 0)
+            return TRUE;
+
+        // If there are pending dispatches we return TRUE to proceed to dispatching ASAP.
+        if (wl_display_prepare_read(source.display) != 0)
+            return TRUE;
+
+        source.isReading = true;
+
+        wl_display_flush(source.display);
+        *timeout = pending;
+        return FALSE;
+    },
+    // check
+    [](GSource* base) -> gboolean
+    {
+        auto& source = *reinterpret_cast<EventSource*>(base);
+
+        // Only perform the read if input was made available during polling,
+        // the events are dispatched by Essos from the dispatch callback.
+        if (source.isReading) {
+            source.isReading = false;
+
+            if (source.pfd.revents & G_IO_IN) {
+                if (wl_display_read_events(source.display) == 0)
+                    return TRUE;
+            } else
+                wl_display_cancel_read(source.display);
+        }
+
+        return source.pfd.revents || source.target->pendingTimeout() == 0;
+    },
+    // dispatch
+    [](GSource* base, GSourceFunc, gpointer) -> gboolean
+    {
+        auto& source = *reinterpret_cast<EventSource*>(base);
+
+        if (source.pfd.revents & (G_IO_ERR | G_IO_HUP)) {
+            ERROR_LOG("Lost connection to the Wayland display");
+            return G_SOURCE_REMOVE;
+        }
+
+        source.pfd.revents = 0;
+        return source.target->runEventLoopOnce();
+    },
+    // finalize
+    [](GSource* base)
+    {
+        auto& source = *reinterpret_cast<EventSource*>(base);
+
+        if (source.isReading) {
+            wl_display_cancel_read(source.display);
+            source.isReading = false;
+        }
+    },
+    nullptr, // closure_callback
+    nullptr, // closure_marshall
+};
+
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::Essos::Visibility>;
+
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     : target(target)
 {
     ipcClient.initialize(*this, hostFd);
+    ipcClient.enableFlowControl(IPC::coalescePointerMotion<IPC::Essos::MsgType::POINTER>);
+    // Input may be corked on the way out, see WPE_IPC_CORK.
+    for (uint64_t code = IPC::Essos::MsgType::AXIS; code <= IPC::Essos::MsgType::KEYBOARD; ++code)
+        ipcClient.setMessageClass(code, IPC::MessageClass::Input);
 }
 
 EGLTarget::~EGLTarget()
 {
     deinitialize();
+
+    if (WPE::statisticsEnabled())
+        latencyStatistics.print();
 }
 
 void EGLTarget::stop()
@@ -256,6 +436,12 @@ void EGLTarget::deinitialize()
     stop();
     ipcClient.deinitialize();
 
+    if (frameCallback) {
+        wl_callback_destroy(frameCallback);
+        frameCallback = nullptr;
+    }
+    surface = nullptr;
+
     if (essosCtx) {
         EssContextSetSettingsListener(essosCtx, nullptr, nullptr);
         EssContextSetKeyListener(essosCtx, nullptr, nullptr);
@@ -290,29 +476,6 @@ void EGLTarget::initialize(Backend& backend, uint32_t width, uint32_t height)
     pageHeight = height;
 
     DEBUG_LOG("initial page size=%ux%u", width, height);
-    static int fps = []() -> int {
-        int result = -1;
-        const char *env = getenv("WPE_ESSOS_CYCLES_PER_SECOND");
-        if (env)
-            result = atoi(env);
-        return result < 0 ? 60 : result;
-    }();
-    eventSource = g_timeout_source_new(1000 / fps);
-    g_source_set_callback(
-        eventSource,
-        [](gpointer data) -> gboolean {
-            EGLTarget& self = *reinterpret_cast<EGLTarget*>(data);
-            return self.runEventLoopOnce();
-        },
-        this,
-        [](gpointer data) {
-            EGLTarget& self = *reinterpret_cast<EGLTarget*>(data);
-            if (self.eventSource)
-                self.deinitialize();
-        });
-    g_source_set_priority(eventSource, G_PRIORITY_HIGH + 30);
-    g_source_set_can_recurse(eventSource, TRUE);
-    g_source_attach(eventSource, g_main_context_get_thread_default());
 
     bool error = false;
     int targetWidth = pageWidth, targetHeight = pageHeight;
@@ -355,6 +518,22 @@ void EGLTarget::initialize(Backend& backend, uint32_t width, uint32_t height)
         // Request page resize if needed
         if ( pageWidth != targetWidth && pageHeight != targetHeight )
             onDisplaySize(targetWidth, targetHeight);
+
+        surfaceTrim.setSize(targetWidth, targetHeight);
+
+#if HAVE_WAYLAND_EGL_BACKEND
+        // Essos creates the wl_egl_window on its own surface, reach it through
+        // the native window. Only built with USE_ESSOS_WAYLAND_EGL_WINDOW, when
+        // the native window is known to be libwayland-egl's.
+        if ( EssContextGetUseWayland(essosCtx) ) {
+            auto* window = reinterpret_cast<struct wl_egl_window*>(nativeWindow);
+            if ( window && window->version == WL_EGL_WINDOW_VERSION )
+                surface = window->surface;
+        }
+#endif
+        DEBUG_LOG("frame completion driven by %s", surface ? "frame callbacks" : "event loop pacing");
+
+        createEventSource();
     }
 
     if ( error ) {
@@ -388,13 +567,136 @@ void EGLTarget::initialize(Backend& backend, uint32_t width, uint32_t height)
     }
 }
 
+void EGLTarget::createEventSource()
+{
+    static int fps = []() -> int {
+        int result = -1;
+        const char *env = getenv("WPE_ESSOS_CYCLES_PER_SECOND");
+        if (env)
+            result = atoi(env);
+        return result <= 0 ? 60 : result;
+    }();
+    static bool forceTimer = !!getenv("WPE_ESSOS_TIMER_LOOP");
+
+    cycleInterval = G_USEC_PER_SEC / fps;
+
+    struct wl_display* display = nullptr;
+    if (!forceTimer && EssContextGetUseWayland(essosCtx))
+        display = static_cast<struct wl_display*>(EssContextGetWaylandDisplay(essosCtx));
+
+    int fd = display ? wl_display_get_fd(display) : -1;
+    if (fd != -1) {
+        DEBUG_LOG("running event loop from display fd %d", fd);
+        frameInterval = cycleInterval;
+
+        eventSource = g_source_new(&EventSource::sourceFuncs, sizeof(EventSource));
+        auto& source = *reinterpret_cast<EventSource*>(eventSource);
+        source.display = display;
+        source.target = this;
+        source.isReading = false;
+        source.pfd.fd = fd;
+        source.pfd.events = G_IO_IN | G_IO_ERR | G_IO_HUP;
+        source.pfd.revents = 0;
+        g_source_add_poll(eventSource, &source.pfd);
+        g_source_set_name(eventSource, "WPE Essos event source");
+    } else {
+        // Direct mode, or forced: Essos reads its input devices itself, poll it.
+        DEBUG_LOG("running event loop %d times per second", fps);
+        timerLoop = true;
+        attachTimerSource(cycleInterval);
+        return;
+    }
+
+    g_source_set_priority(eventSource, G_PRIORITY_HIGH + 30);
+    g_source_set_can_recurse(eventSource, TRUE);
+    g_source_attach(eventSource, g_main_context_get_thread_default());
+}
+
+void EGLTarget::attachTimerSource(gint64 interval)
+{
+    eventSource = g_timeout_source_new(interval / 1000);
+    g_source_set_callback(
+        eventSource,
+        [](gpointer data) -> gboolean {
+            EGLTarget& self = *reinterpret_cast<EGLTarget*>(data);
+            return self.runEventLoopOnce();
+        },
+        this,
+        [](gpointer data) {
+            EGLTarget& self = *reinterpret_cast<EGLTarget*>(data);
+            if (self.eventSource)
+                self.deinitialize();
+        });
+
+    g_source_set_priority(eventSource, G_PRIORITY_HIGH + 30);
+    g_source_set_can_recurse(eventSource, TRUE);
+    g_source_attach(eventSource, g_main_context_get_thread_default());
+}
+
+void EGLTarget::setVisible(bool isVisible)
+{
+    surfaceTrim.setVisible(isVisible);
+    if (isVisible == visible)
+        return;
+
+    visible = isVisible;
+    DEBUG_LOG("view %s", visible ? "shown" : "hidden");
+
+    // Held completions go out at the next cycle. A hidden view lost the
+    // keyboard focus, whatever key was down repeats no more.
+    if (visible)
+        nextFrameCompleteTime = 0;
+    else
+        repeatKey = 0;
+
+    // The display fd source picks the new deadlines up by itself. The timer
+    // only has to run at the hidden rate, and at least once a second so
+    // Essos keeps up with its devices.
+    if (timerLoop && eventSource) {
+        auto* timer = std::exchange(eventSource, nullptr);
+        g_source_destroy(timer);
+        g_source_unref(timer);
+
+        gint64 hiddenInterval = WPE::FrameThrottle::hiddenInterval();
+        attachTimerSource(visible ? cycleInterval : std::max(hiddenInterval ? hiddenInterval : G_USEC_PER_SEC, cycleInterval));
+    }
+}
+
+// Milliseconds until the event loop has to run without input from the
+// display, -1 if nothing is scheduled.
+int EGLTarget::pendingTimeout() const
+{
+    gint64 now = g_get_monotonic_time();
+    gint64 deadline = -1;
+    if (shouldDispatchFrameComplete && !visible && surfaceTrim.awaitsFrame())
+        deadline = 0;
+    else if (shouldDispatchFrameComplete && (visible || WPE::FrameThrottle::hiddenInterval()))
+        deadline = nextFrameCompleteTime;
+    if (keyRepeating(now) && (deadline == -1 || lastCycleTime + cycleInterval < deadline))
+        deadline = lastCycleTime + cycleInterval;
+    if (deadline == -1)
+        return -1;
+
+    gint64 remaining = deadline - now;
+    return remaining > 0 ? (remaining + 999) / 1000 : 0;
+}
+
 gboolean EGLTarget::runEventLoopOnce()
 {
     if (essosCtx)
         EssContextRunEventLoopOnce( essosCtx );
 
-    if ( shouldDispatchFrameComplete ) {
+    gint64 now = g_get_monotonic_time();
+    lastCycleTime = now;
+
+    // The frame that frees the buffers of a trimmed window does not wait.
+    gint64 hiddenInterval = WPE::FrameThrottle::hiddenInterval();
+    bool exempt = !visible && surfaceTrim.awaitsFrame();
+    if ( shouldDispatchFrameComplete && (exempt || (now >= nextFrameCompleteTime && (visible || hiddenInterval))) ) {
         --shouldDispatchFrameComplete;
+        nextFrameCompleteTime = now + (visible ? frameInterval : hiddenInterval);
+        if (timeline)
+            timeline->record(WPE::FrameTimeline::FrameComplete);
         wpe_renderer_backend_egl_target_dispatch_frame_complete( target );
     }
     return G_SOURCE_CONTINUE;
@@ -406,7 +708,8 @@ void EGLTarget::handleMessage(char* data, size_t size)
         return;
 
     auto& message = IPC::Message::cast(data);
-    ERROR_LOG("EGLTarget: unhandled message (%d)", message.messageCode);
+    if (!EGLTargetMessages::dispatch(*this, message))
+        ERROR_LOG("EGLTarget: unhandled message (%d)", message.messageCode);
 }
 
 void EGLTarget::resize(uint32_t width, uint32_t height)
@@ -416,7 +719,26 @@ void EGLTarget::resize(uint32_t width, uint32_t height)
     pageWidth = width;
     pageHeight = height;
 
-    EssContextResizeWindow(essosCtx, width, height);
+    if (surfaceTrim.setSize(width, height))
+        resizeWindow(width, height);
+}
+
+void EGLTarget::resizeWindow(uint32_t width, uint32_t height)
+{
+    if (essosCtx)
+        EssContextResizeWindow(essosCtx, width, height);
+}
+
+void EGLTarget::frameWillRender()
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::WillRender);
+
+    // Requested ahead of eglSwapBuffers so that it applies to its commit.
+    if (surface && !frameCallback) {
+        frameCallback = wl_surface_frame(surface);
+        wl_callback_add_listener(frameCallback, &frameListener, this);
+    }
 }
 
 void EGLTarget::frameRendered()
@@ -424,11 +746,16 @@ void EGLTarget::frameRendered()
     if (essosCtx == nullptr)
        return;
 
-    IPC::Message message;
-    message.messageCode = IPC::Essos::MsgType::FRAMERENDERED;
-    ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::Rendered);
+    surfaceTrim.frameRendered();
 
-    ++shouldDispatchFrameComplete;
+    if (frameCallback) {
+        frameRenderedTime = g_get_monotonic_time();
+    } else {
+        sendFrameRendered();
+        ++shouldDispatchFrameComplete;
+    }
 
     if ( EssContextGetUseWayland(essosCtx) ) {
         void* display = EssContextGetWaylandDisplay( essosCtx );
@@ -436,6 +763,51 @@ void EGLTarget::frameRendered()
     }
 }
 
+void EGLTarget::frameDisplayed()
+{
+    wl_callback_destroy(frameCallback);
+    frameCallback = nullptr;
+
+    // Requested for a frame that was never swapped, nobody waits for it.
+    if (!frameRenderedTime)
+        return;
+
+    uint64_t latency = g_get_monotonic_time() - std::exchange(frameRenderedTime, 0);
+    DEBUG_LOG("frame displayed %.2fms after swap", latency / 1000.0);
+
+    latencyStatistics.frames++;
+    latencyStatistics.totalTime += latency;
+    latencyStatistics.maxTime = std::max(latencyStatistics.maxTime, latency);
+
+    sendFrameRendered();
+
+    // While hidden the completion waits for the event loop pacing.
+    if (!visible) {
+        ++shouldDispatchFrameComplete;
+        return;
+    }
+
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete( target );
+}
+
+void EGLTarget::sendFrameRendered()
+{
+    IPC::Message message;
+    IPC::encode(message, IPC::Essos::FrameRendered { });
+    ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
+
+void EGLTarget::LatencyStatistics::print() const
+{
+    if (!frames)
+        return;
+
+    fprintf(stderr, "Essos::EGLTarget: %llu frames, send-to-display latency %.2fms on average, %.2fms at most\n",
+        static_cast<unsigned long long>(frames), totalTime / 1000.0 / frames, maxTime / 1000.0);
+}
+
 bool EGLTarget::updateKeyModifiers(unsigned int key, bool pressed)
 {
     bool isModifierKey = false;
@@ -522,8 +894,7 @@ void EGLTarget::onKeyEvent(unsigned int key, bool pressed)
             time, keysym, key, pressed, modifiers
         };
     IPC::Message message;
-    message.messageCode = IPC::Essos::MsgType::KEYBOARD;
-    memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, IPC::Essos::KeyboardEvent { event });
     ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -541,8 +912,7 @@ void EGLTarget::onPointerMotion(int x, int y)
             time, x, y, 0, 0, inputModifiers
         };
     IPC::Message message;
-    message.messageCode = IPC::Essos::MsgType::POINTER;
-    memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, IPC::Essos::PointerEvent { event });
     ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -586,8 +956,7 @@ void EGLTarget::onPointerButton(int button, int x, int y, bool pressed)
         };
 
     IPC::Message message;
-    message.messageCode = IPC::Essos::MsgType::POINTER;
-    memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, IPC::Essos::PointerEvent { event });
     ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -600,8 +969,7 @@ void EGLTarget::onTouchDown(int id, int x, int y)
             time, id, x, y
         };
     IPC::Message message;
-    message.messageCode = IPC::Essos::MsgType::TOUCHSIMPLE;
-    memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, IPC::Essos::TouchSimpleEvent { event });
     ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -614,8 +982,7 @@ void EGLTarget::onTouchUp(int id)
             time, id, 0, 0
         };
     IPC::Message message;
-    message.messageCode = IPC::Essos::MsgType::TOUCHSIMPLE;
-    memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, IPC::Essos::TouchSimpleEvent { event });
     ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -628,8 +995,7 @@ void EGLTarget::onTouchMoution(int id, int x, int y)
             time, id, x, y
         };
     IPC::Message message;
-    message.messageCode = IPC::Essos::MsgType::TOUCHSIMPLE;
-    memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, IPC::Essos::TouchSimpleEvent { event });
     ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -637,7 +1003,7 @@ void EGLTarget::onDisplaySize(int width, int height)
 {
     DEBUG_LOG("display size=%dx%d, page size=%dx%d", width, height, pageWidth, pageHeight);
     IPC::Message message;
-    IPC::Essos::DisplaySize::construct(message, width, height);
+    IPC::encode(message, IPC::Essos::DisplaySize { static_cast<uint32_t>(width), static_cast<uint32_t>(height) });
     ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -724,6 +1090,8 @@ struct wpe_renderer_backend_egl_target_interface essos_renderer_backend_egl_targ
     // frame_will_render
     [](void* data)
     {
+        auto& target = *static_cast<Essos::EGLTarget*>(data);
+        target.frameWillRender();
     },
     // frame_rendered
     [](void* data)
@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <cstdio>
 
+#include "frame-throttle.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-essos.h"
 
@@ -48,11 +50,28 @@ struct ViewBackend : public IPC::Host::Handler
     void handleMessage(char*, size_t) override;
 
     void initialize();
+    void sendVisibility(bool);
+
+    // IPC messages
+    void handle(const IPC::Essos::AxisEvent&);
+    void handle(const IPC::Essos::PointerEvent&);
+    void handle(const IPC::Essos::TouchSimpleEvent&);
+    void handle(const IPC::Essos::KeyboardEvent&);
+    void handle(const IPC::Essos::FrameRendered&);
+    void handle(const IPC::Essos::DisplaySize& displaySize) { wpe_view_backend_dispatch_set_size(backend, displaySize.width, displaySize.height); }
 
     struct wpe_view_backend* backend;
     IPC::Host ipcHost;
+
+    // Only watches visibility, the renderer completes frames by itself.
+    WPE::FrameThrottle throttle { backend, "Essos::ViewBackend", nullptr, nullptr };
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("Essos::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
 };
 
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend,
+    IPC::Essos::AxisEvent, IPC::Essos::PointerEvent, IPC::Essos::TouchSimpleEvent, IPC::Essos::KeyboardEvent,
+    IPC::Essos::FrameRendered, IPC::Essos::DisplaySize>;
+
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : backend(backend)
 {
@@ -67,6 +86,10 @@ ViewBackend::ViewBackend(struct wpe_view_backend* backend)
         }
     }
     ipcHost.initialize(*this);
+    for (uint64_t code = IPC::Essos::MsgType::AXIS; code <= IPC::Essos::MsgType::KEYBOARD; ++code)
+        ipcHost.setMessageClass(code, IPC::MessageClass::Input);
+
+    throttle.watchVisibility([](void* data, bool visible) { static_cast<ViewBackend*>(data)->sendVisibility(visible); }, this);
 }
 
 ViewBackend::~ViewBackend()
@@ -80,47 +103,50 @@ void ViewBackend::handleMessage(char* data, size_t size)
         return;
 
     auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::Essos::MsgType::AXIS:
-    {
-        struct wpe_input_axis_event * event = reinterpret_cast<wpe_input_axis_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_axis_event(backend, event);
-        break;
-    }
-    case IPC::Essos::MsgType::POINTER:
-    {
-        struct wpe_input_pointer_event * event = reinterpret_cast<wpe_input_pointer_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_pointer_event(backend, event);
-        break;
-    }
-    case IPC::Essos::MsgType::TOUCHSIMPLE:
-    {
-        struct wpe_input_touch_event_raw * touchpoint = reinterpret_cast<wpe_input_touch_event_raw*>(std::addressof(message.messageData));
-        struct wpe_input_touch_event event = { touchpoint, 1, touchpoint->type, touchpoint->id, touchpoint->time, 0 };
-        wpe_view_backend_dispatch_touch_event(backend, &event);
-        break;
-    }
-    case IPC::Essos::MsgType::KEYBOARD:
-    {
-        struct wpe_input_keyboard_event * event = reinterpret_cast<wpe_input_keyboard_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_keyboard_event(backend, event);
-        break;
-    }
-    case IPC::Essos::MsgType::FRAMERENDERED:
-    {
-        wpe_view_backend_dispatch_frame_displayed(backend);
-        break;
-    }
-    case IPC::Essos::MsgType::DISPLAYSIZE:
-    {
-        auto& displaySize = IPC::Essos::DisplaySize::cast(message);
-        wpe_view_backend_dispatch_set_size(backend, displaySize.width, displaySize.height);
-        break;
-    }
-    default:
+    if (!ViewBackendMessages::dispatch(*this, message))
         ERROR_LOG("ViewBackend: unhandled message (%d)", message.messageCode);
-        break;
-    }
+}
+
+// The renderer completes frames by itself, FrameRendered tells that one was
+// displayed. It is also when the embedder hiding the view gets noticed.
+void ViewBackend::handle(const IPC::Essos::FrameRendered&)
+{
+    throttle.checkVisibility();
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameDisplayed);
+    wpe_view_backend_dispatch_frame_displayed(backend);
+}
+
+void ViewBackend::sendVisibility(bool visible)
+{
+    IPC::Message message;
+    IPC::encode(message, IPC::Essos::Visibility { visible });
+    ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
+
+void ViewBackend::handle(const IPC::Essos::AxisEvent& message)
+{
+    struct wpe_input_axis_event event = message.data;
+    wpe_view_backend_dispatch_axis_event(backend, &event);
+}
+
+void ViewBackend::handle(const IPC::Essos::PointerEvent& message)
+{
+    struct wpe_input_pointer_event event = message.data;
+    wpe_view_backend_dispatch_pointer_event(backend, &event);
+}
+
+void ViewBackend::handle(const IPC::Essos::TouchSimpleEvent& message)
+{
+    struct wpe_input_touch_event_raw touchpoint = message.data;
+    struct wpe_input_touch_event event = { &touchpoint, 1, touchpoint.type, touchpoint.id, touchpoint.time, 0 };
+    wpe_view_backend_dispatch_touch_event(backend, &event);
+}
+
+void ViewBackend::handle(const IPC::Essos::KeyboardEvent& message)
+{
+    struct wpe_input_keyboard_event event = message.data;
+    wpe_view_backend_dispatch_keyboard_event(backend, &event);
 }
 
 void ViewBackend::initialize()
@@ -27,8 +27,10 @@
 
 #include <wpe/wpe-egl.h>
 
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-intelce.h"
+#include "ipc-message.h"
 #include <EGL/egl.h>
 #include <libgdl.h>
 
@@ -40,14 +42,23 @@ struct EGLTarget : public IPC::Client::Handler {
 
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
+    void handleSignal(uint64_t) override;
+
+    // IPC messages
+    void handle(const IPC::IntelCE::FrameComplete&);
 
     struct wpe_renderer_backend_egl_target* target;
     IPC::Client ipcClient;
 
     uint32_t width { 0 };
     uint32_t height { 0 };
+    uint32_t frameSequence { 0 };
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("IntelCE::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::IntelCE::FrameComplete>;
+
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     : target(target)
 {
@@ -64,16 +75,21 @@ void EGLTarget::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::IntelCE::FrameComplete::code:
-    {
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-        break;
-    }
-    default:
+    if (!EGLTargetMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "EGLTarget: unhandled message\n");
-    };
+}
+
+// FrameComplete, once the host signals it through an eventfd.
+void EGLTarget::handleSignal(uint64_t)
+{
+    handle(IPC::IntelCE::FrameComplete { });
+}
+
+void EGLTarget::handle(const IPC::IntelCE::FrameComplete&)
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 } // namespace IntelCE
@@ -128,14 +144,19 @@ struct wpe_renderer_backend_egl_target_interface intelce_renderer_backend_egl_ta
     // frame_will_render
     [](void* data)
     {
+        auto& target = *static_cast<IntelCE::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::WillRender);
     },
     // frame_rendered
     [](void* data)
     {
         auto& target = *static_cast<IntelCE::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::Rendered);
 
         IPC::Message message;
-        IPC::IntelCE::BufferCommit::construct(message, target.width, target.height);
+        IPC::encode(message, IPC::IntelCE::BufferCommit { target.width, target.height, ++target.frameSequence });
         target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
     },
 };
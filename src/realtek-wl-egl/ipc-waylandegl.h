@@ -29,7 +29,6 @@
 #ifndef wpe_platform_ipc_wayland_egl_h
 #define wpe_platform_ipc_wayland_egl_h
 
-#include <memory>
 #include <stdint.h>
 
 namespace IPC {
@@ -37,34 +36,12 @@ namespace IPC {
 namespace WaylandEGL {
 
 struct BufferCommit {
-    uint8_t padding[Message::dataSize];
-
     static const uint64_t code = 1;
-    static void construct(Message& message)
-    {
-        message.messageCode = code;
-    }
-    static BufferCommit& cast(Message& message)
-    {
-        return *reinterpret_cast<BufferCommit*>(std::addressof(message.messageData));
-    }
 };
-static_assert(sizeof(BufferCommit) == Message::dataSize, "BufferCommit is of correct size");
 
 struct FrameComplete {
-    int8_t padding[Message::dataSize];
-
     static const uint64_t code = 2;
-    static void construct(Message& message)
-    {
-        message.messageCode = code;
-    }
-    static FrameComplete& cast(Message& message)
-    {
-        return *reinterpret_cast<FrameComplete*>(std::addressof(message.messageData));
-    }
 };
-static_assert(sizeof(FrameComplete) == Message::dataSize, "FrameComplete is of correct size");
 
 } // namespace WaylandEGL
 
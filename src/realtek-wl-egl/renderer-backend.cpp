@@ -31,8 +31,10 @@
 #include <wpe/wpe-egl.h>
 
 #include "display.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-waylandegl.h"
+#include "ipc-message.h"
 #include <wayland-client-protocol.h>
 
 namespace WaylandEGL {
@@ -61,6 +63,9 @@ struct EGLTarget : public IPC::Client::Handler {
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
 
+    // IPC messages
+    void handle(const IPC::WaylandEGL::FrameComplete&);
+
     struct wpe_renderer_backend_egl_target* target;
     IPC::Client ipcClient;
 
@@ -68,8 +73,12 @@ struct EGLTarget : public IPC::Client::Handler {
     struct wl_shell_surface *m_shellSurface { nullptr };
     struct wl_egl_window* m_window { nullptr };
     Backend* m_backend { nullptr };
+
+    std::unique_ptr<WPE::FrameTimeline> m_timeline { WPE::FrameTimeline::create("WaylandEGL::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::WaylandEGL::FrameComplete>;
+
 static void
 handle_ping(void *data, struct wl_shell_surface *shell_surface,
                                                        uint32_t serial)
@@ -159,16 +168,15 @@ void EGLTarget::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::WaylandEGL::FrameComplete::code:
-    {
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-        break;
-    }
-    default:
+    if (!EGLTargetMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "EGLTarget: unhandled message\n");
-    };
+}
+
+void EGLTarget::handle(const IPC::WaylandEGL::FrameComplete&)
+{
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 } // namespace WaylandEGL
@@ -227,18 +235,23 @@ struct wpe_renderer_backend_egl_target_interface wayland_egl_renderer_backend_eg
     // frame_will_render
     [](void* data)
     {
+        auto& target = *static_cast<WaylandEGL::EGLTarget*>(data);
+        if (target.m_timeline)
+            target.m_timeline->record(WPE::FrameTimeline::WillRender);
     },
     // frame_rendered
     [](void* data)
     {
         auto& target = *static_cast<WaylandEGL::EGLTarget*>(data);
+        if (target.m_timeline)
+            target.m_timeline->record(WPE::FrameTimeline::Rendered);
 
         wl_display *display = target.m_backend->display.display();
         if(display)
             wl_display_flush(display);
 
         IPC::Message message;
-        IPC::WaylandEGL::BufferCommit::construct(message);
+        IPC::encode(message, IPC::WaylandEGL::BufferCommit { });
         target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
     },
 };
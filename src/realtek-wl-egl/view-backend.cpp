@@ -28,8 +28,10 @@
 
 #include <wpe/wpe.h>
 #include "display.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-waylandegl.h"
+#include "ipc-message.h"
 
 #define WIDTH 1280
 #define HEIGHT 720
@@ -49,14 +51,29 @@ struct ViewBackend : public IPC::Host::Handler {
     void ackBufferCommit();
     void initialize();
 
+    // IPC messages
+    void handle(const Wayland::EventDispatcher::AxisEvent&);
+    void handle(const Wayland::EventDispatcher::PointerEvent&);
+    void handle(const Wayland::EventDispatcher::TouchEvent&);
+    void handle(const Wayland::EventDispatcher::KeyboardEvent&);
+    void handle(const IPC::WaylandEGL::BufferCommit&) { ackBufferCommit(); }
+
     struct wpe_view_backend* backend;
     IPC::Host ipcHost;
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("WaylandEGL::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
 };
 
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend,
+    Wayland::EventDispatcher::AxisEvent, Wayland::EventDispatcher::PointerEvent, Wayland::EventDispatcher::TouchEvent,
+    Wayland::EventDispatcher::KeyboardEvent, IPC::WaylandEGL::BufferCommit>;
+
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : backend(backend)
 {
     ipcHost.initialize(*this);
+    for (uint64_t code = Wayland::EventDispatcher::MsgType::AXIS; code <= Wayland::EventDispatcher::MsgType::KEYBOARD; ++code)
+        ipcHost.setMessageClass(code, IPC::MessageClass::Input);
 }
 
 ViewBackend::~ViewBackend()
@@ -69,40 +86,32 @@ void ViewBackend::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case Wayland::EventDispatcher::MsgType::AXIS:
-    {
-        struct wpe_input_axis_event * event = reinterpret_cast<wpe_input_axis_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_axis_event(backend, event);
-        break;
-    }
-    case Wayland::EventDispatcher::MsgType::POINTER:
-    {
-        struct wpe_input_pointer_event * event = reinterpret_cast<wpe_input_pointer_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_pointer_event(backend, event);
-        break;
-    }
-    case Wayland::EventDispatcher::MsgType::TOUCH:
-    {
-        struct wpe_input_touch_event * event = reinterpret_cast<wpe_input_touch_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_touch_event(backend, event);
-        break;
-    }
-    case Wayland::EventDispatcher::MsgType::KEYBOARD:
-    {
-        struct wpe_input_keyboard_event * event = reinterpret_cast<wpe_input_keyboard_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_keyboard_event(backend, event);
-        break;
-    }
-    case IPC::WaylandEGL::BufferCommit::code:
-    {
-        ackBufferCommit();
-        break;
-    }
-    default:
+    if (!ViewBackendMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "ViewBackend: unhandled message\n");
-    }
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::AxisEvent& message)
+{
+    struct wpe_input_axis_event event = message.data;
+    wpe_view_backend_dispatch_axis_event(backend, &event);
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::PointerEvent& message)
+{
+    struct wpe_input_pointer_event event = message.data;
+    wpe_view_backend_dispatch_pointer_event(backend, &event);
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::TouchEvent& message)
+{
+    struct wpe_input_touch_event event = message.data;
+    wpe_view_backend_dispatch_touch_event(backend, &event);
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::KeyboardEvent& message)
+{
+    struct wpe_input_keyboard_event event = message.data;
+    wpe_view_backend_dispatch_keyboard_event(backend, &event);
 }
 
 void ViewBackend::initialize()
@@ -121,10 +130,17 @@ void ViewBackend::initialize()
 
 void ViewBackend::ackBufferCommit()
 {
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::BufferCommit);
+
     IPC::Message message;
-    IPC::WaylandEGL::FrameComplete::construct(message);
+    IPC::encode(message, IPC::WaylandEGL::FrameComplete { });
     ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
 
+    if (timeline) {
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+        timeline->record(WPE::FrameTimeline::FrameDisplayed);
+    }
     wpe_view_backend_dispatch_frame_displayed(backend);
 }
 
@@ -25,7 +25,6 @@
  */
 
 #include "display.h"
-#include <cstring>
 #include <chrono>
 #include <KeyMapper/KeyMapperWpe.h>
 
@@ -175,16 +174,6 @@ void KeyboardHandler::HandleKeyEvent(const uint32_t key, const IKeyboard::state
     _callback->Touch(index, state, x, y);
 }
 
-gboolean vsyncCallback (gpointer data) {
-    Compositor::IDisplay* _display = static_cast <Compositor::IDisplay *> (data);
-
-    if (_display != nullptr) {
-        /* int */ _display->Process (0);
-    }
-
-    return TRUE;
-}
-
  class EventSource {
  public:
      static GSourceFuncs sourceFuncs;
@@ -192,33 +181,44 @@ gboolean vsyncCallback (gpointer data) {
      GSource source;
      GPollFD pfd;
      Compositor::IDisplay* display;
-     signed int result;
+     // Set once a frame was rendered, so that the connection is processed,
+     // and flushed, before the main loop goes back to sleep.
+     bool processPending;
  };
 
+ // This is the only place where the compositor connection is processed,
+ // whether it has events to read or a frame was rendered.
  GSourceFuncs EventSource::sourceFuncs = {
      // prepare
      [](GSource* base, gint* timeout) -> gboolean {
+         EventSource& source(*(reinterpret_cast<EventSource*>(base)));
+
          *timeout = -1;
-         return FALSE;
+         return source.processPending ? TRUE : FALSE;
      },
      // check
      [](GSource* base) -> gboolean {
          EventSource& source(*(reinterpret_cast<EventSource*>(base)));
 
-         source.result = source.display->Process(source.pfd.revents & G_IO_IN);
-
-         return (source.result >= 0 ? TRUE : FALSE);
+         return (source.processPending || (source.pfd.revents & (G_IO_IN | G_IO_ERR | G_IO_HUP))) ? TRUE : FALSE;
      },
      // dispatch
      [](GSource* base, GSourceFunc, gpointer) -> gboolean {
          EventSource& source(*(reinterpret_cast<EventSource*>(base)));
 
-         if ((source.result == 1) || (source.pfd.revents & (G_IO_ERR | G_IO_HUP))) {
+         if (source.pfd.revents & (G_IO_ERR | G_IO_HUP)) {
              fprintf(stderr, "Compositor::Display: error in compositor dispatch\n");
              return G_SOURCE_REMOVE;
          }
 
+         source.processPending = false;
+         int result = source.display->Process(source.pfd.revents & G_IO_IN);
          source.pfd.revents = 0;
+
+         if (result == 1) {
+             fprintf(stderr, "Compositor::Display: error in compositor dispatch\n");
+             return G_SOURCE_REMOVE;
+         }
          return G_SOURCE_CONTINUE;
      },
      nullptr, // finalize
@@ -243,65 +243,30 @@ Display::Display(IPC::Client& ipc, const std::string& name)
     int descriptor = m_display->FileDescriptor();
     EventSource* source(reinterpret_cast<EventSource*>(m_eventSource));
 
-    if (descriptor != -1) {
-        source->display = m_display;
-        source->pfd.fd = descriptor;
-        source->pfd.events = G_IO_IN | G_IO_ERR | G_IO_HUP;
-        source->pfd.revents = 0;
+    source->display = m_display;
+    source->pfd.fd = descriptor;
+    source->pfd.events = G_IO_IN | G_IO_ERR | G_IO_HUP;
+    source->pfd.revents = 0;
+    source->processPending = false;
 
+    // Without a descriptor the source still processes after every frame.
+    if (descriptor != -1)
         g_source_add_poll(m_eventSource, &source->pfd);
-        g_source_set_name(m_eventSource, "[WPE] Display");
-        g_source_set_priority(m_eventSource, G_PRIORITY_DEFAULT);
-        g_source_set_can_recurse(m_eventSource, TRUE);
-        g_source_attach(m_eventSource, g_main_context_get_thread_default());
-    }
+    g_source_set_name(m_eventSource, "[WPE] Display");
+    g_source_set_priority(m_eventSource, G_PRIORITY_DEFAULT);
+    g_source_set_can_recurse(m_eventSource, TRUE);
+    g_source_attach(m_eventSource, g_main_context_get_thread_default());
 }
 
-static constexpr gint FD_TIMEOUT () {
-    // Milliseconds
-    // -1, infinite
-    // 0, immediate
-
-    return 0;
+void Display::FrameRendered()
+{
+    reinterpret_cast<EventSource*>(m_eventSource)->processPending = true;
 }
 
-bool Display::vSyncCallback () {
-    static_assert (std::is_integral < gint >::value, "Integral type required");
-    static_assert (std::is_integral < decltype (m_display->FileDescriptor ()) >::value, "Integral type required");
-    static_assert (std::numeric_limits < gint >::min () >= std::numeric_limits < decltype (m_display->FileDescriptor ()) >::min (), "Integer range exceeded");
-    static_assert (std::numeric_limits < gint >::max () <= std::numeric_limits < decltype (m_display->FileDescriptor ()) >::max (), "Integer range exceeded");
-
-    static gint _fd = m_display->FileDescriptor ();
-
-    gushort _flags = 0;
-
-    if (_fd != -1) {
-        // Watchh for data to read, errors or broken connection
-        GPollFD _gfd =  {_fd, /* events to poll */ G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL, /* resulting events of poll */ _flags};
-
-        switch (g_poll (&_gfd, /* number of entries */ 1, /* timeout */ FD_TIMEOUT ())) {
-            case -1 :   // Error
-            case 0  :   // Timed out, always for timeout equal 0
-                        _flags = 0;
-                        break;
-            default :   // Return value should match g_poll's second field
-                        // Signal there is data to read
-                        _flags = _gfd.revents & (G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL);
-        }
-     }
-
-    static_assert (std::is_integral < decltype (_flags) >::value, "Integral type required");
-    static_assert (std::numeric_limits < decltype (_flags) >::min () >= std::numeric_limits < uint32_t >::min (), "Integer range exceeded");
-    static_assert (std::numeric_limits < decltype (_flags) >::max () <= std::numeric_limits < uint32_t >::max (), "Integer range exceeded");
-
-    // If the loop 'runs' too fast check the implementation of Process
-    // You may want to add a delay based on the underlying platform just there
-
-    return (m_display != nullptr ? 0 == m_display->Process (_flags) : false);
-}
- 
 Display::~Display()
 {
+    g_source_destroy(m_eventSource);
+    g_source_unref(m_eventSource);
     m_display->Release();
 }
 
@@ -319,8 +284,7 @@ Display::~Display()
     sendCode = WPE::KeyMapper::KeyCodeToWpeKey(keycode, _modifiers);
     struct wpe_input_keyboard_event event{ TimeNow(), sendCode, actual_key, !!actions, _modifiers };
     IPC::Message message;
-    message.messageCode = MsgType::KEYBOARD;
-    std::memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, KeyboardEvent { event });
     m_ipc.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -329,8 +293,7 @@ Display::~Display()
     struct wpe_input_keyboard_event event = { time, keycode, hardware_keycode, pressed, modifiers };
 
     IPC::Message message;
-    message.messageCode = MsgType::KEYBOARD;
-    std::memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, KeyboardEvent { event });
     m_ipc.sendMessage(IPC::Message::data(message), IPC::Message::size);
     // TODO: this is not needed but it was done in the wayland-egl code, lets remove this later.
     // wpe_view_backend_dispatch_keyboard_event(m_backend, &event);
@@ -381,32 +344,28 @@ void Display::Touch(const uint8_t index, const Compositor::IDisplay::ITouchPanel
 void Display::SendEvent(wpe_input_axis_event& event)
 {
     IPC::Message message;
-    message.messageCode = MsgType::AXIS;
-    std::memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, AxisEvent { event });
     m_ipc.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
 void Display::SendEvent(wpe_input_pointer_event& event)
 {
     IPC::Message message;
-    message.messageCode = MsgType::POINTER;
-    std::memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, PointerEvent { event });
     m_ipc.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
 void Display::SendEvent(wpe_input_touch_event& event)
 {
     IPC::Message message;
-    message.messageCode = MsgType::TOUCH;
-    std::memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, TouchEvent { event });
     m_ipc.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
 void Display::SendEvent(wpe_input_touch_event_raw& event)
 {
     IPC::Message message;
-    message.messageCode = MsgType::TOUCHSIMPLE;
-    std::memcpy(message.messageData, &event, sizeof(event));
+    IPC::encode(message, TouchSimpleEvent { event });
     m_ipc.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
@@ -28,6 +28,7 @@
 #define wpe_view_backend_thunder_display_h
 
 #include "ipc.h"
+#include "ipc-message.h"
 #include <assert.h>
 #include <wpe/wpe.h>
 #include <compositor/Client.h>
@@ -201,6 +202,12 @@ public:
 	KEYBOARD
     };
 
+    using AxisEvent = IPC::MessageOf<MsgType::AXIS, wpe_input_axis_event>;
+    using PointerEvent = IPC::MessageOf<MsgType::POINTER, wpe_input_pointer_event>;
+    using TouchEvent = IPC::MessageOf<MsgType::TOUCH, wpe_input_touch_event>;
+    using TouchSimpleEvent = IPC::MessageOf<MsgType::TOUCHSIMPLE, wpe_input_touch_event_raw>;
+    using KeyboardEvent = IPC::MessageOf<MsgType::KEYBOARD, wpe_input_keyboard_event>;
+
 public:
     Display(IPC::Client& ipc, const std::string& name);
     ~Display();
@@ -226,7 +233,9 @@ public:
     void SendEvent(wpe_input_touch_event& event);
     void SendEvent(wpe_input_touch_event_raw& event);
 
-    bool vSyncCallback ();
+    // Has the compositor connection processed from the main loop, instead
+    // of synchronously in the frame_rendered hook.
+    void FrameRendered();
 
 private:
 
@@ -29,64 +29,24 @@
 #ifndef wpe_platform_ipc_thunder_h
 #define wpe_platform_ipc_thunder_h
 
-#include <memory>
 #include <stdint.h>
 
 namespace IPC {
 
 struct BufferCommit {
-    uint8_t padding[Message::dataSize];
-
     static const uint64_t code = 1;
-    static void construct(Message& message)
-    {
-        message.messageCode = code;
-    }
-    static BufferCommit& cast(Message& message)
-    {
-        return *reinterpret_cast<BufferCommit*>(std::addressof(message.messageData));
-    }
 };
-static_assert(sizeof(BufferCommit) == Message::dataSize, "BufferCommit is of correct size");
 
 struct FrameComplete {
-    int8_t padding[Message::dataSize];
-
     static const uint64_t code = 2;
-    static void construct(Message& message)
-    {
-        message.messageCode = code;
-    }
-    static FrameComplete& cast(Message& message)
-    {
-        return *reinterpret_cast<FrameComplete*>(std::addressof(message.messageData));
-    }
 };
-static_assert(sizeof(FrameComplete) == Message::dataSize, "FrameComplete is of correct size");
 
 struct AdjustedDimensions {
-    uint32_t width;
-    uint32_t height;
-    uint8_t padding[24];
-
     static const uint64_t code = 3;
 
-    static void construct(Message& message, uint32_t width, uint32_t height)
-    {
-        message.messageCode = code;
-
-        AdjustedDimensions& messageData = *reinterpret_cast<AdjustedDimensions*>(std::addressof(message.messageData));
-
-        messageData.width = width;
-        messageData.height = height;
-    }
-
-    static AdjustedDimensions& cast(Message& message)
-    {
-        return *reinterpret_cast<AdjustedDimensions*>(std::addressof(message.messageData));
-    }
+    uint32_t width;
+    uint32_t height;
 };
-static_assert(sizeof(AdjustedDimensions) == Message::dataSize, "AdjustedDimensions is of incorrect size");
 
 } // namespace IPC
 
@@ -27,9 +27,14 @@
 #include <wpe/wpe-egl.h>
 
 #include "display.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-buffer.h"
+#include "ipc-flow-policy.h"
+#include "ipc-message.h"
+#include "statistics.h"
 
+#include <algorithm>
 #include <chrono>
 #include <string>
 #include <string.h>
@@ -43,6 +48,10 @@ struct EGLTarget : public IPC::Client::Handler {
     void initialize(struct wpe_view_backend* backend, uint32_t width, uint32_t height);
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
+    void handleSignal(uint64_t) override;
+
+    // IPC messages
+    void handle(const IPC::FrameComplete&);
 
     struct wpe_renderer_backend_egl_target* target;
     IPC::Client ipcClient;
@@ -53,8 +62,21 @@ struct EGLTarget : public IPC::Client::Handler {
 
     Display display;
     Compositor::IDisplay::ISurface* surface;
+
+    // Time spent in the frame_rendered hook, with WPE_RDK_STATISTICS set.
+    struct FrameStatistics {
+        void print() const;
+
+        uint64_t frames { 0 };
+        uint64_t totalTime { 0 };
+        uint64_t maxTime { 0 };
+    } frameStatistics;
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("Thunder::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::FrameComplete>;
+
 static std::string DisplayName() {
     std::string name = Compositor::IDisplay::SuggestedName();
 
@@ -70,6 +92,10 @@ EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     , display(ipcClient, DisplayName())
 {
     ipcClient.initialize(*this, hostFd);
+    ipcClient.enableFlowControl(IPC::coalescePointerMotion<Display::MsgType::POINTER>);
+    // Input may be corked on the way out, see WPE_IPC_CORK.
+    for (uint64_t code = Display::MsgType::AXIS; code <= Display::MsgType::KEYBOARD; ++code)
+        ipcClient.setMessageClass(code, IPC::MessageClass::Input);
 }
 
 void EGLTarget::initialize(struct wpe_view_backend* backend, uint32_t width, uint32_t height)
@@ -96,7 +122,7 @@ void EGLTarget::initialize(struct wpe_view_backend* backend, uint32_t width, uin
     if (width != static_cast <width_t>(s_width) || height != static_cast<height_t>(s_height)) {
         IPC::Message message;
 
-        IPC::AdjustedDimensions::construct(message, surface->Width(), surface->Height());
+        IPC::encode(message, IPC::AdjustedDimensions { static_cast<uint32_t>(s_width), static_cast<uint32_t>(s_height) });
 
         ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
     }
@@ -106,25 +132,41 @@ void EGLTarget::initialize(struct wpe_view_backend* backend, uint32_t width, uin
 
 EGLTarget::~EGLTarget()
 {
+    if (WPE::statisticsEnabled())
+        frameStatistics.print();
     ipcClient.deinitialize();
     surface->Release();
 }
 
 void EGLTarget::handleMessage(char* data, size_t size)
 {
-    if (size == IPC::Message::size)
-    {
-        auto& message = IPC::Message::cast(data);
-        switch (message.messageCode) {
-        case IPC::FrameComplete::code:
-        {
-            wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-            break;
-        }
-        default:
-            fprintf(stderr, "EGLTarget: unhandled message\n");
-        }
-    };
+    if (size != IPC::Message::size)
+        return;
+
+    if (!EGLTargetMessages::dispatch(*this, IPC::Message::cast(data)))
+        fprintf(stderr, "EGLTarget: unhandled message\n");
+}
+
+void EGLTarget::FrameStatistics::print() const
+{
+    if (!frames)
+        return;
+
+    fprintf(stderr, "Thunder::EGLTarget: %llu frames, frame_rendered took %.2fus on average, %.2fus at most\n",
+        static_cast<unsigned long long>(frames), totalTime / 1000.0 / frames, maxTime / 1000.0);
+}
+
+// FrameComplete, once the host signals it through an eventfd.
+void EGLTarget::handleSignal(uint64_t)
+{
+    handle(IPC::FrameComplete { });
+}
+
+void EGLTarget::handle(const IPC::FrameComplete&)
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 } // namespace Thunder
@@ -190,21 +232,38 @@ struct wpe_renderer_backend_egl_target_interface thunder_renderer_backend_egl_ta
     // frame_will_render
     [](void* data)
     {
+        Thunder::EGLTarget& target (*static_cast<Thunder::EGLTarget*>(data));
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::WillRender);
     },
     // frame_rendered
     [](void* data)
     {
         Thunder::EGLTarget& target (*static_cast<Thunder::EGLTarget*>(data));
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::Rendered);
 
-        /* bool */ target.display.vSyncCallback ();
+        std::chrono::steady_clock::time_point start;
+        if (WPE::statisticsEnabled())
+            start = std::chrono::steady_clock::now();
 
-        // The message has to be sent regardless of the vSyncCallback result.
-        // Otherwise, the 'frame complete' is never sent, possibly breaking 
-        // the feedback loop.
+        // The compositor connection is processed from the main loop once
+        // this returns, the frame itself only costs the BufferCommit.
+        target.display.FrameRendered();
 
-        IPC::Message message;
-        IPC::BufferCommit::construct(message);
-        target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+        if (!target.ipcClient.sendSignal()) {
+            IPC::Message message;
+            IPC::encode(message, IPC::BufferCommit { });
+            target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+        }
+
+        if (WPE::statisticsEnabled()) {
+            uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            auto& statistics = target.frameStatistics;
+            ++statistics.frames;
+            statistics.totalTime += elapsed;
+            statistics.maxTime = std::max(statistics.maxTime, elapsed);
+        }
     },
 };
 
@@ -28,16 +28,15 @@
 
 #include <wpe/wpe.h>
 #include "display.h"
+#include "frame-pipeline.h"
+#include "frame-throttle.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-buffer.h"
+#include "ipc-message.h"
+#include "vsync-source.h"
 #include <array>
 
-#define __RPI_BACKEND_VSYNC__ 1
-
-#ifdef __RPI_BACKEND_VSYNC__
-#include "bcm_host.h"
-#endif
-
 #define WIDTH 1280
 #define HEIGHT 720
 
@@ -50,74 +49,53 @@ struct ViewBackend : public IPC::Host::Handler {
     // IPC::Host::Handler
     void handleFd(int) override { };
     void handleMessage(char*, size_t) override;
+    void handleSignal(uint64_t) override { commitBuffer(); }
 
     void initialize();
 
-    static gboolean vsyncCallback(gpointer);
+    // IPC messages
+    void handle(const Display::AxisEvent&);
+    void handle(const Display::PointerEvent&);
+    void handle(const Display::TouchEvent&);
+    void handle(const Display::TouchSimpleEvent&);
+    void handle(const Display::KeyboardEvent&);
+    void handle(const IPC::AdjustedDimensions&);
+    void handle(const IPC::BufferCommit&) { commitBuffer(); }
+
+    void commitBuffer();
+    void releaseFrame();
+
+    static bool vsyncCallback(uint64_t, void*);
 
     struct wpe_view_backend* backend;
     std::array<struct wpe_input_touch_event_raw, 10> touchpoints;
     IPC::Host ipcHost;
-    GSource* vsyncSource;
-    bool triggered;
-
-    #ifdef __RPI_BACKEND_VSYNC__
-    DISPMANX_DISPLAY_HANDLE_T displayHandle;
-    #endif
+    std::unique_ptr<WPE::VSyncSource> vsyncSource;
+    // Committed frames, each vsync displays the oldest one.
+    WPE::FramePipeline pipeline { "Thunder::ViewBackend" };
+    // Holds FrameComplete back while the view is hidden.
+    WPE::FrameThrottle throttle { backend, "Thunder::ViewBackend", [](void* data) { static_cast<ViewBackend*>(data)->releaseFrame(); }, this };
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("Thunder::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
 };
 
-#ifdef __RPI_BACKEND_VSYNC__
-static void VSyncCallback(DISPMANX_UPDATE_HANDLE_T update, void* userData);
-#endif
-
-static GSource* MaxFPS() {
-    uint32_t tickDelay = 10; // 100 frames per second should be MAX and the default.
-    const char* max_FPS = ::getenv("WEBKIT_MAXIMUM_FPS");
-
-    if (max_FPS != nullptr) {
-        uint32_t configValue = ::atoi(max_FPS);
-        if ((configValue >= 1) && (configValue <= 100)) {
-            tickDelay = (1000 / configValue);
-
-        }
-        if (configValue == 0) {
-            tickDelay = 0;
-        }
-    }
-   
-    return (tickDelay > 0 ? g_timeout_source_new(tickDelay) : nullptr);
-}
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend,
+    Display::AxisEvent, Display::PointerEvent, Display::TouchEvent, Display::TouchSimpleEvent, Display::KeyboardEvent,
+    IPC::AdjustedDimensions, IPC::BufferCommit>;
 
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : backend(backend)
-    , vsyncSource(MaxFPS())
-    , triggered(false)
-    #ifdef __RPI_BACKEND_VSYNC__
-    , displayHandle(NULL)
-    #endif
 {
     ipcHost.initialize(*this);
-
-    if (vsyncSource != nullptr) {
-        g_source_set_callback(vsyncSource, static_cast<GSourceFunc>(vsyncCallback), this, nullptr);
-        g_source_set_priority(vsyncSource, G_PRIORITY_HIGH + 30);
-        g_source_set_can_recurse(vsyncSource, TRUE);
-        g_source_attach(vsyncSource, g_main_context_get_thread_default());
-    }
+    ipcHost.enableSignals();
+    for (uint64_t code = Display::MsgType::AXIS; code <= Display::MsgType::KEYBOARD; ++code)
+        ipcHost.setMessageClass(code, IPC::MessageClass::Input);
 
     touchpoints.fill({ wpe_input_touch_event_type_null, 0, 0, 0, 0 });
 }
 
 ViewBackend::~ViewBackend()
 {
-    if (vsyncSource != nullptr) {
-        g_source_destroy(vsyncSource);
-    }
-    #ifdef __RPI_BACKEND_VSYNC__
-    else if (displayHandle != NULL) {
-        vc_dispmanx_display_close(displayHandle);
-    }
-    #endif
+    vsyncSource = nullptr;
     ipcHost.deinitialize();
 }
 
@@ -126,66 +104,56 @@ void ViewBackend::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case Display::MsgType::AXIS:
-    {
-        struct wpe_input_axis_event * event = reinterpret_cast<wpe_input_axis_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_axis_event(backend, event);
-        break;
-    }
-    case Display::MsgType::POINTER:
-    {
-        struct wpe_input_pointer_event * event = reinterpret_cast<wpe_input_pointer_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_pointer_event(backend, event);
-        break;
-    }
-    case Display::MsgType::TOUCH: // UNUSED!
-    {
-        struct wpe_input_touch_event * event = reinterpret_cast<wpe_input_touch_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_touch_event(backend, event);
-        break;
-    }
-    case Display::MsgType::TOUCHSIMPLE:
-    {
-        struct wpe_input_touch_event_raw * tp = reinterpret_cast<wpe_input_touch_event_raw*>(std::addressof(message.messageData));
-        if ((tp->id >= 0) && (tp->id < static_cast<int32_t>(touchpoints.size()))) {
-            auto& point = touchpoints[tp->id];
-            point = { tp->type, tp->time, tp->id, tp->x, tp->y };
-
-            struct wpe_input_touch_event event = { touchpoints.data(), touchpoints.size(), tp->type, tp->id, tp->time, 0 };
-            wpe_view_backend_dispatch_touch_event(backend, &event);
-
-            // Free the slot if the touch disappears.
-            if (tp->type == wpe_input_touch_event_type_up) {
-                point = { wpe_input_touch_event_type_null, 0, -1, -1, -1 };
-            }
+    if (!ViewBackendMessages::dispatch(*this, IPC::Message::cast(data)))
+        fprintf(stderr, "ViewBackend: unhandled message\n");
+}
+
+void ViewBackend::handle(const Display::AxisEvent& message)
+{
+    struct wpe_input_axis_event event = message.data;
+    wpe_view_backend_dispatch_axis_event(backend, &event);
+}
+
+void ViewBackend::handle(const Display::PointerEvent& message)
+{
+    struct wpe_input_pointer_event event = message.data;
+    wpe_view_backend_dispatch_pointer_event(backend, &event);
+}
+
+void ViewBackend::handle(const Display::TouchEvent& message) // UNUSED!
+{
+    struct wpe_input_touch_event event = message.data;
+    wpe_view_backend_dispatch_touch_event(backend, &event);
+}
+
+void ViewBackend::handle(const Display::TouchSimpleEvent& message)
+{
+    const struct wpe_input_touch_event_raw& tp = message.data;
+    if ((tp.id >= 0) && (tp.id < static_cast<int32_t>(touchpoints.size()))) {
+        auto& point = touchpoints[tp.id];
+        point = { tp.type, tp.time, tp.id, tp.x, tp.y };
+
+        struct wpe_input_touch_event event = { touchpoints.data(), touchpoints.size(), tp.type, tp.id, tp.time, 0 };
+        wpe_view_backend_dispatch_touch_event(backend, &event);
+
+        // Free the slot if the touch disappears.
+        if (tp.type == wpe_input_touch_event_type_up) {
+            point = { wpe_input_touch_event_type_null, 0, -1, -1, -1 };
         }
-        break;
-    }
-    case Display::MsgType::KEYBOARD:
-    {
-        struct wpe_input_keyboard_event * event = reinterpret_cast<wpe_input_keyboard_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_keyboard_event(backend, event);
-        break;
     }
-    case IPC::AdjustedDimensions::code:
-    {
-        IPC::AdjustedDimensions dimensions = IPC::AdjustedDimensions::cast(message);
+}
 
-        wpe_view_backend_dispatch_set_size(backend, dimensions.width, dimensions.height);
+void ViewBackend::handle(const Display::KeyboardEvent& message)
+{
+    struct wpe_input_keyboard_event event = message.data;
+    wpe_view_backend_dispatch_keyboard_event(backend, &event);
+}
 
-        fprintf(stdout,"Adjusted (internal buffer) dimensions to %u x %u\n", dimensions.width, dimensions.height);
-        break;
-    }
-    case IPC::BufferCommit::code:
-    {
-        triggered = true;
-        break;
-    }
-    default:
-        fprintf(stderr, "ViewBackend: unhandled message\n");
-    }
+void ViewBackend::handle(const IPC::AdjustedDimensions& dimensions)
+{
+    wpe_view_backend_dispatch_set_size(backend, dimensions.width, dimensions.height);
+
+    fprintf(stdout,"Adjusted (internal buffer) dimensions to %u x %u\n", dimensions.width, dimensions.height);
 }
 
 void ViewBackend::initialize()
@@ -203,37 +171,53 @@ void ViewBackend::initialize()
     }
     wpe_view_backend_dispatch_set_size( backend, width, height);
 
-    #ifdef __RPI_BACKEND_VSYNC__
-    if (vsyncSource == nullptr) {
-        displayHandle = vc_dispmanx_display_open(0);
-        vc_dispmanx_vsync_callback(displayHandle, VSyncCallback, this);
-    }
-    #endif
+    // Without dispmanx, keep pacing at the 100 Hz this backend always used.
+    vsyncSource = WPE::VSyncSource::create(vsyncCallback, this, 100);
 }
 
-/* static */ gboolean ViewBackend::vsyncCallback(gpointer data)
+void ViewBackend::commitBuffer()
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::BufferCommit);
+
+    if (pipeline.commit())
+        throttle.release();
+
+    if (vsyncSource)
+        vsyncSource->start();
+    else
+        vsyncCallback(0, this);
+}
+
+/* static */ bool ViewBackend::vsyncCallback(uint64_t, void* data)
 {
     ViewBackend* impl = static_cast<ViewBackend*>(data);
 
-    if (impl->triggered) {
-        impl->triggered = false;
-        IPC::Message message;
-        IPC::FrameComplete::construct(message);
-        impl->ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    // Nothing was committed since the last frame, the vsync source stops
+    // until the next commit.
+    if (!impl->pipeline.hasPending())
+        return false;
 
-        wpe_view_backend_dispatch_frame_displayed(impl->backend);
-    }
+    if (impl->pipeline.displayed())
+        impl->throttle.release();
 
-    return (G_SOURCE_CONTINUE);
+    if (impl->timeline)
+        impl->timeline->record(WPE::FrameTimeline::FrameDisplayed);
+    wpe_view_backend_dispatch_frame_displayed(impl->backend);
+    return true;
 }
 
-#ifdef __RPI_BACKEND_VSYNC__
-static void VSyncCallback(DISPMANX_UPDATE_HANDLE_T update, void* userData)
+void ViewBackend::releaseFrame()
 {
-    ViewBackend::vsyncCallback((gpointer) userData);
-} 
-#endif
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
 
+    if (!ipcHost.sendSignal()) {
+        IPC::Message message;
+        IPC::encode(message, IPC::FrameComplete { });
+        ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    }
+}
 
 } // namespace Thunder
 
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "frame-pipeline.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+namespace WPE {
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+const unsigned FramePipeline::maximumDepth;
+
+unsigned FramePipeline::defaultDepth()
+{
+    static unsigned depth = []() -> unsigned {
+        const char* env = std::getenv("WPE_FRAME_PIPELINE_DEPTH");
+        if (!env)
+            return 1;
+
+        int value = std::atoi(env);
+        if (value < 1 || value > static_cast<int>(maximumDepth)) {
+            fprintf(stderr, "WPE::FramePipeline: WPE_FRAME_PIPELINE_DEPTH must be between 1 and %u\n", maximumDepth);
+            value = std::min<int>(std::max(value, 1), maximumDepth);
+        }
+        return value;
+    }();
+    return depth;
+}
+
+FramePipeline::FramePipeline(const char* name, unsigned depth)
+    : m_name(name)
+    , m_depth(std::min(std::max(depth, 1u), maximumDepth))
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+    if (statisticsEnabled())
+        m_statistics.print(m_name, m_depth);
+}
+
+bool FramePipeline::commit()
+{
+    return commit(m_nextSequence);
+}
+
+bool FramePipeline::commit(uint32_t sequence)
+{
+    if (sequence != m_nextSequence)
+        m_statistics.outOfSequence++;
+    m_nextSequence = sequence + 1;
+
+    // The renderer commits again only once released, so the queue cannot
+    // overflow unless it got out of step. Drop the oldest frame then.
+    if (m_count == m_frames.size()) {
+        m_first = (m_first + 1) % m_frames.size();
+        m_count--;
+    }
+
+    m_frames[(m_first + m_count) % m_frames.size()] = { sequence, monotonicTime() };
+    m_count++;
+
+    m_held = m_count >= m_depth;
+    if (!m_held)
+        m_statistics.early++;
+    return !m_held;
+}
+
+bool FramePipeline::displayed()
+{
+    if (!m_count)
+        return false;
+
+    const Frame& frame = m_frames[m_first];
+    uint64_t latency = monotonicTime() - frame.commitTime;
+    m_statistics.frames++;
+    m_statistics.totalLatency += latency;
+    m_statistics.maxLatency = std::max(m_statistics.maxLatency, latency);
+
+    m_first = (m_first + 1) % m_frames.size();
+    m_count--;
+
+    if (!m_held || m_count >= m_depth)
+        return false;
+    m_held = false;
+    return true;
+}
+
+void FramePipeline::Statistics::print(const char* name, unsigned depth) const
+{
+    if (!frames)
+        return;
+
+    fprintf(stderr, "%s: pipeline depth %u, %llu frames, %llu released early, %llu out of sequence, commit-to-display %.2fms on average, %.2fms at most\n",
+        name, depth, static_cast<unsigned long long>(frames), static_cast<unsigned long long>(early),
+        static_cast<unsigned long long>(outOfSequence), totalLatency / 1e6 / frames, maxLatency / 1e6);
+}
+
+} // namespace WPE
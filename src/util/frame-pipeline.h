@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_frame_pipeline_h
+#define wpe_platform_frame_pipeline_h
+
+#include <array>
+#include <stdint.h>
+
+namespace WPE {
+
+// The frames a renderer committed that the view backend did not display yet,
+// for the backends where FrameComplete is acknowledged over IPC and a vsync
+// or presentation feedback tells when a frame was displayed.
+//
+// With a depth of 1 the renderer runs in lock-step: the FrameComplete for a
+// commit is only released once that frame was displayed. A deeper pipeline
+// releases it as soon as the commit arrives while fewer than depth frames are
+// queued, so the renderer prepares frame N+1 while frame N still waits for
+// the display, and IPC or main loop jitter no longer costs a refresh. Every
+// extra stage adds up to one refresh of latency. WPE_FRAME_PIPELINE_DEPTH
+// sets the depth, from 1 to 3, 1 by default.
+//
+// Frames carry sequence numbers. commit() takes the renderer's when the
+// BufferCommit message has one, and numbers frames in arrival order when it
+// does not, e.g. for commits sent as signals.
+class FramePipeline {
+public:
+    static const unsigned maximumDepth = 3;
+    static unsigned defaultDepth();
+
+    explicit FramePipeline(const char* name, unsigned depth = defaultDepth());
+    ~FramePipeline();
+
+    unsigned depth() const { return m_depth; }
+    bool hasPending() const { return !!m_count; }
+
+    // Queues a committed frame. Returns whether its FrameComplete can be
+    // released right away, otherwise displayed() releases it later.
+    bool commit();
+    bool commit(uint32_t sequence);
+
+    // The oldest queued frame reached the display. Returns whether this
+    // releases the FrameComplete that was held back.
+    bool displayed();
+
+    struct Statistics {
+        void print(const char* name, unsigned depth) const;
+
+        uint64_t frames { 0 };
+        // Completions released before their frame was displayed.
+        uint64_t early { 0 };
+        // Commits whose sequence number was not the expected one.
+        uint64_t outOfSequence { 0 };
+        uint64_t totalLatency { 0 };
+        uint64_t maxLatency { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+
+private:
+    struct Frame {
+        uint32_t sequence;
+        uint64_t commitTime;
+    };
+
+    const char* m_name;
+    unsigned m_depth;
+
+    std::array<Frame, maximumDepth> m_frames;
+    unsigned m_first { 0 };
+    unsigned m_count { 0 };
+    uint32_t m_nextSequence { 1 };
+    // The completion of the newest frame waits for an older one to go.
+    bool m_held { false };
+
+    Statistics m_statistics;
+};
+
+} // namespace WPE
+
+#endif // wpe_platform_frame_pipeline_h
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "frame-throttle.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <wpe/wpe.h>
+
+#if defined(WPE_CHECK_VERSION)
+#if WPE_CHECK_VERSION(1, 1, 0)
+#define HAVE_WPE_ACTIVITY_STATE 1
+#endif
+#endif
+
+namespace WPE {
+
+const unsigned FrameThrottle::pollInterval;
+
+// Microseconds between completions while hidden, 0 when suspended.
+uint64_t FrameThrottle::hiddenInterval()
+{
+    static uint64_t interval = []() -> uint64_t {
+        const char* env = std::getenv("WPE_HIDDEN_FRAME_RATE");
+        if (!env)
+            return G_USEC_PER_SEC;
+
+        int fps = std::atoi(env);
+        if (fps < 0 || fps > 60) {
+            fprintf(stderr, "WPE::FrameThrottle: WPE_HIDDEN_FRAME_RATE must be between 0 and 60\n");
+            fps = std::min(std::max(fps, 0), 60);
+        }
+        return fps ? G_USEC_PER_SEC / fps : 0;
+    }();
+    return interval;
+}
+
+FrameThrottle::FrameThrottle(struct wpe_view_backend* backend, const char* name, ReleaseFunction releaseFunction, void* releaseData)
+    : m_backend(backend)
+    , m_name(name)
+    , m_releaseFunction(releaseFunction)
+    , m_releaseData(releaseData)
+{
+}
+
+FrameThrottle::~FrameThrottle()
+{
+    if (m_timer) {
+        g_source_destroy(m_timer);
+        g_source_unref(m_timer);
+    }
+    if (m_watchTimer) {
+        g_source_destroy(m_watchTimer);
+        g_source_unref(m_watchTimer);
+    }
+
+    m_visibilityFunction = nullptr;
+    updateVisibility(true);
+    if (statisticsEnabled())
+        m_statistics.print(m_name);
+}
+
+void FrameThrottle::setVisible(bool visible)
+{
+    if (visible == m_compositorVisible)
+        return;
+
+    m_compositorVisible = visible;
+#if defined(HAVE_WPE_ACTIVITY_STATE)
+    if (visible)
+        wpe_view_backend_add_activity_state(m_backend, wpe_view_activity_state_visible);
+    else
+        wpe_view_backend_remove_activity_state(m_backend, wpe_view_activity_state_visible);
+#endif
+
+    if (isVisible())
+        releaseHeld();
+}
+
+bool FrameThrottle::isVisible()
+{
+    bool visible = m_compositorVisible;
+#if defined(HAVE_WPE_ACTIVITY_STATE)
+    if (wpe_view_backend_get_activity_state(m_backend) & wpe_view_activity_state_visible)
+        m_activityStateSeen = true;
+    else if (m_activityStateSeen)
+        visible = false;
+#endif
+
+    updateVisibility(visible);
+    return visible;
+}
+
+void FrameThrottle::release()
+{
+    m_held++;
+    if (isVisible()) {
+        releaseHeld();
+        return;
+    }
+
+    if (m_exempt) {
+        m_exempt = false;
+        releaseNow();
+        return;
+    }
+
+    m_statistics.held++;
+    schedule();
+}
+
+void FrameThrottle::exemptFrame()
+{
+    if (m_held)
+        releaseNow();
+    else
+        m_exempt = true;
+}
+
+void FrameThrottle::watchVisibility(VisibilityFunction function, void* data)
+{
+    m_visibilityFunction = function;
+    m_visibilityData = data;
+
+    if (m_hiddenSince)
+        startWatching();
+}
+
+void FrameThrottle::checkVisibility()
+{
+    if (isVisible())
+        releaseHeld();
+}
+
+void FrameThrottle::startWatching()
+{
+#if defined(HAVE_WPE_ACTIVITY_STATE)
+    if (m_watchTimer || !m_visibilityFunction)
+        return;
+
+    m_watchTimer = g_timeout_source_new(pollInterval);
+    g_source_set_callback(m_watchTimer, watchTimeout, this, nullptr);
+    g_source_attach(m_watchTimer, g_main_context_get_thread_default());
+#endif
+}
+
+gboolean FrameThrottle::watchTimeout(gpointer data)
+{
+    auto& throttle = *static_cast<FrameThrottle*>(data);
+    if (!throttle.isVisible())
+        return G_SOURCE_CONTINUE;
+
+    g_source_unref(throttle.m_watchTimer);
+    throttle.m_watchTimer = nullptr;
+    throttle.releaseHeld();
+    return G_SOURCE_REMOVE;
+}
+
+// Releases the oldest held completion.
+void FrameThrottle::releaseNow()
+{
+    if (m_timer) {
+        g_source_destroy(m_timer);
+        g_source_unref(m_timer);
+        m_timer = nullptr;
+    }
+
+    if (m_hiddenSince)
+        m_statistics.releasedHidden++;
+
+    m_held--;
+    m_lastRelease = g_get_monotonic_time();
+    m_releaseFunction(m_releaseData);
+}
+
+void FrameThrottle::releaseHeld()
+{
+    m_exempt = false;
+    while (m_held)
+        releaseNow();
+}
+
+void FrameThrottle::schedule()
+{
+    if (m_timer || !m_held)
+        return;
+
+    // At the hidden rate, one completion per interval.
+    uint64_t interval = hiddenInterval();
+    uint64_t now = g_get_monotonic_time();
+    if (interval && now >= m_lastRelease + interval) {
+        releaseNow();
+        if (!m_held)
+            return;
+        now = m_lastRelease;
+    }
+
+    // Without activity states only the compositor changes visibility, and
+    // setVisible() releases what is held by itself. The watch timer, when
+    // running, already looks for the embedder showing the view.
+    uint64_t wait = interval ? m_lastRelease + interval - now : G_MAXUINT64;
+#if defined(HAVE_WPE_ACTIVITY_STATE)
+    if (!m_watchTimer)
+        wait = std::min<uint64_t>(wait, pollInterval * 1000);
+#endif
+    if (wait == G_MAXUINT64)
+        return;
+
+    m_timer = g_timeout_source_new((wait + 999) / 1000);
+    g_source_set_callback(m_timer, timeout, this, nullptr);
+    g_source_attach(m_timer, g_main_context_get_thread_default());
+}
+
+gboolean FrameThrottle::timeout(gpointer data)
+{
+    auto& throttle = *static_cast<FrameThrottle*>(data);
+    g_source_unref(throttle.m_timer);
+    throttle.m_timer = nullptr;
+
+    if (throttle.isVisible())
+        throttle.releaseHeld();
+    else
+        throttle.schedule();
+    return G_SOURCE_REMOVE;
+}
+
+void FrameThrottle::updateVisibility(bool visible)
+{
+    if (visible == !m_hiddenSince)
+        return;
+
+    if (!visible) {
+        m_hiddenSince = g_get_monotonic_time();
+        m_statistics.hiddenPeriods++;
+        startWatching();
+    } else {
+        m_statistics.hiddenTime += g_get_monotonic_time() - m_hiddenSince;
+        m_hiddenSince = 0;
+    }
+
+    if (m_visibilityFunction)
+        m_visibilityFunction(m_visibilityData, visible);
+}
+
+void FrameThrottle::Statistics::print(const char* name) const
+{
+    if (!hiddenPeriods)
+        return;
+
+    fprintf(stderr, "%s: hidden %llu times for %.1fs in total, %llu frame completions held back, %llu released while hidden\n",
+        name, static_cast<unsigned long long>(hiddenPeriods), hiddenTime / 1e6,
+        static_cast<unsigned long long>(held), static_cast<unsigned long long>(releasedHidden));
+}
+
+} // namespace WPE
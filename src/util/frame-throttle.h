@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_frame_throttle_h
+#define wpe_platform_frame_throttle_h
+
+#include <glib.h>
+#include <stdint.h>
+
+struct wpe_view_backend;
+
+namespace WPE {
+
+// Holds back FrameComplete while a view is hidden, so a backgrounded
+// browser stops drawing at the display rate and leaves the CPU and GPU to
+// the foreground application.
+//
+// A view is hidden when the compositor says so through setVisible(), which
+// also tells WebKit by toggling the visible activity state, or when the
+// embedder removed the visible activity state, as app managers do when they
+// background a browser. The latter only counts once the view was seen
+// visible, embedders that never set activity states are not throttled.
+//
+// While hidden, FrameComplete goes out at WPE_HIDDEN_FRAME_RATE frames per
+// second, 1 by default, or not at all with 0. Held completions are released
+// as soon as the view is visible again. The embedder hiding the view is
+// noticed at the next frame, showing it again within pollInterval. Nothing
+// is polled while the view is visible.
+class FrameThrottle {
+public:
+    using ReleaseFunction = void (*)(void*);
+
+    FrameThrottle(struct wpe_view_backend*, const char* name, ReleaseFunction, void*);
+    ~FrameThrottle();
+
+    void setVisible(bool);
+    bool isVisible();
+
+    // Sends FrameComplete through the release function, now while visible,
+    // otherwise once the hidden rate or visibility allow it.
+    void release();
+
+    // Lets one completion out whatever the hidden rate: the one held now,
+    // otherwise the next one. For the frame that frees a trimmed window's
+    // buffers, see WPE::SurfaceTrim.
+    void exemptFrame();
+
+    // Calls the function whenever the view is shown or hidden, for backends
+    // that free resources of hidden views. While hidden, the embedder's
+    // activity state is then polled even when no frames are held, so that
+    // showing the view is noticed without a frame. Backends that only watch,
+    // and never call release(), may pass no release function and call
+    // checkVisibility() once per frame instead.
+    using VisibilityFunction = void (*)(void*, bool visible);
+    void watchVisibility(VisibilityFunction, void*);
+    void checkVisibility();
+
+    static const unsigned pollInterval = 100;
+
+    // Microseconds between completions while hidden, 0 when suspended.
+    static uint64_t hiddenInterval();
+
+    struct Statistics {
+        void print(const char* name) const;
+
+        uint64_t hiddenPeriods { 0 };
+        uint64_t hiddenTime { 0 };
+        // Completions that had to wait, and those released while hidden.
+        uint64_t held { 0 };
+        uint64_t releasedHidden { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+
+private:
+    static gboolean timeout(gpointer);
+    static gboolean watchTimeout(gpointer);
+
+    void releaseNow();
+    void releaseHeld();
+    void schedule();
+    void startWatching();
+    void updateVisibility(bool visible);
+
+    struct wpe_view_backend* m_backend;
+    const char* m_name;
+    ReleaseFunction m_releaseFunction;
+    void* m_releaseData;
+
+    bool m_compositorVisible { true };
+    bool m_activityStateSeen { false };
+    // Completions waiting, one per release() while hidden.
+    unsigned m_held { 0 };
+    bool m_exempt { false };
+    uint64_t m_lastRelease { 0 };
+    // When the view was last found hidden, 0 while visible.
+    uint64_t m_hiddenSince { 0 };
+    GSource* m_timer { nullptr };
+
+    VisibilityFunction m_visibilityFunction { nullptr };
+    void* m_visibilityData { nullptr };
+    // Only runs while the view is hidden.
+    GSource* m_watchTimer { nullptr };
+
+    Statistics m_statistics;
+};
+
+} // namespace WPE
+
+#endif // wpe_platform_frame_throttle_h
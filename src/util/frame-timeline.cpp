@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "frame-timeline.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+namespace WPE {
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+const unsigned FrameTimeline::capacity;
+const uint64_t FrameTimeline::idleInterval;
+const unsigned FrameTimeline::eventBits;
+
+std::unique_ptr<FrameTimeline> FrameTimeline::create(const char* name, Event frameEvent)
+{
+    // Zero when disabled.
+    static uint64_t reportInterval = []() -> uint64_t {
+        const char* env = std::getenv("WPE_RDK_FRAME_TIMELINE");
+        if (!env)
+            return 0;
+
+        int seconds = std::atoi(env);
+        if (seconds <= 0)
+            seconds = 5;
+        return static_cast<uint64_t>(seconds) * 1000000000;
+    }();
+
+    if (!reportInterval)
+        return nullptr;
+    return std::unique_ptr<FrameTimeline>(new FrameTimeline(name, frameEvent, reportInterval));
+}
+
+FrameTimeline::FrameTimeline(const char* name, Event frameEvent, uint64_t reportInterval)
+    : m_name(name)
+    , m_frameEvent(frameEvent)
+    , m_reportInterval(reportInterval)
+    , m_refreshInterval(1000000000 / 60)
+    , m_lastReport(monotonicTime())
+{
+    for (auto& event : m_events)
+        event.store(0, std::memory_order_relaxed);
+}
+
+FrameTimeline::~FrameTimeline()
+{
+    report(m_lastReport.load(std::memory_order_relaxed)).print(m_name);
+}
+
+void FrameTimeline::record(Event event)
+{
+    record(event, monotonicTime());
+}
+
+void FrameTimeline::record(Event event, uint64_t timestamp)
+{
+    uint64_t position = m_head.fetch_add(1, std::memory_order_relaxed);
+    m_events[position % capacity].store(timestamp << eventBits | event, std::memory_order_release);
+
+    if (event == m_frameEvent)
+        maybeReport(timestamp);
+}
+
+void FrameTimeline::setRefreshInterval(uint64_t interval)
+{
+    if (interval)
+        m_refreshInterval.store(interval, std::memory_order_relaxed);
+}
+
+void FrameTimeline::maybeReport(uint64_t timestamp)
+{
+    if (!m_reportInterval)
+        return;
+
+    uint64_t last = m_lastReport.load(std::memory_order_relaxed);
+    if (timestamp < last + m_reportInterval)
+        return;
+
+    // Only one of the threads that get here prints.
+    if (m_lastReport.compare_exchange_strong(last, timestamp, std::memory_order_relaxed))
+        report(last).print(m_name);
+}
+
+FrameTimeline::Report FrameTimeline::report(uint64_t since) const
+{
+    std::array<uint64_t, capacity> events;
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t first = head > capacity ? head - capacity : 0;
+    for (uint64_t position = first; position < head; ++position)
+        events[position % capacity] = m_events[position % capacity].load(std::memory_order_acquire);
+
+    // Whatever was written over while copying is not part of this report.
+    uint64_t newHead = m_head.load(std::memory_order_acquire);
+    if (newHead > capacity)
+        first = std::max(first, newHead - capacity);
+
+    const uint64_t refresh = m_refreshInterval.load(std::memory_order_relaxed);
+
+    Report report;
+    std::array<uint64_t, capacity> intervals;
+    unsigned intervalCount = 0;
+    uint64_t intervalSum = 0;
+    uint64_t lastFrame = 0;
+    uint64_t lastWillRender = 0;
+    // Commits still waiting for their FrameComplete, oldest first. A few are
+    // enough for the deepest pipeline; if completions were missed, the oldest
+    // commits make room.
+    std::array<uint64_t, 4> commits;
+    unsigned firstCommit = 0, commitCount = 0;
+    uint64_t renderTimeSum = 0, renderCount = 0;
+    uint64_t completeLatencySum = 0, completeCount = 0;
+
+    for (uint64_t position = first; position < head; ++position) {
+        uint64_t value = events[position % capacity];
+        uint64_t timestamp = value >> eventBits;
+        auto event = static_cast<Event>(value & ((1 << eventBits) - 1));
+        // Not written yet, or from before the period this report covers.
+        if (!timestamp || timestamp < since)
+            continue;
+
+        if (event == m_frameEvent) {
+            report.frames++;
+            if (lastFrame && timestamp > lastFrame && timestamp - lastFrame <= idleInterval) {
+                uint64_t interval = timestamp - lastFrame;
+                intervals[intervalCount++] = interval;
+                intervalSum += interval;
+                uint64_t refreshes = (interval + refresh / 2) / refresh;
+                if (refreshes > 1)
+                    report.missedVSyncs += refreshes - 1;
+            }
+            lastFrame = timestamp;
+        }
+
+        switch (event) {
+        case WillRender:
+            lastWillRender = timestamp;
+            break;
+        case Rendered:
+            if (lastWillRender && timestamp >= lastWillRender) {
+                renderTimeSum += timestamp - lastWillRender;
+                renderCount++;
+            }
+            lastWillRender = 0;
+            break;
+        case BufferCommit:
+            if (commitCount == commits.size()) {
+                firstCommit = (firstCommit + 1) % commits.size();
+                commitCount--;
+            }
+            commits[(firstCommit + commitCount++) % commits.size()] = timestamp;
+            break;
+        case FrameComplete:
+            // With a deeper pipeline several commits can be waiting, the
+            // oldest one is the one this FrameComplete is for.
+            if (commitCount) {
+                uint64_t commit = commits[firstCommit];
+                firstCommit = (firstCommit + 1) % commits.size();
+                commitCount--;
+                if (timestamp >= commit) {
+                    completeLatencySum += timestamp - commit;
+                    completeCount++;
+                }
+            }
+            break;
+        case FrameDisplayed:
+            break;
+        }
+    }
+
+    if (intervalCount) {
+        std::sort(intervals.begin(), intervals.begin() + intervalCount);
+        auto percentile = [&](unsigned p) { return intervals[(intervalCount - 1) * p / 100]; };
+        report.p50 = percentile(50);
+        report.p95 = percentile(95);
+        report.p99 = percentile(99);
+        report.maxInterval = intervals[intervalCount - 1];
+        report.fps = intervalCount * 1e9 / intervalSum;
+    }
+    if (renderCount)
+        report.renderTime = renderTimeSum / renderCount;
+    if (completeCount)
+        report.completeLatency = completeLatencySum / completeCount;
+    return report;
+}
+
+void FrameTimeline::Report::print(const char* name) const
+{
+    if (!frames)
+        return;
+
+    fprintf(stderr, "%s: %llu frames, %.1f fps, %llu missed vsyncs, frame interval p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms",
+        name, static_cast<unsigned long long>(frames), fps, static_cast<unsigned long long>(missedVSyncs),
+        p50 / 1e6, p95 / 1e6, p99 / 1e6, maxInterval / 1e6);
+    if (renderTime)
+        fprintf(stderr, ", render %.2fms", renderTime / 1e6);
+    if (completeLatency)
+        fprintf(stderr, ", commit-to-complete %.2fms", completeLatency / 1e6);
+    fprintf(stderr, "\n");
+}
+
+} // namespace WPE
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_frame_timeline_h
+#define wpe_platform_frame_timeline_h
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace WPE {
+
+// When frames go through the hooks of a renderer or view backend, kept in a
+// ring of the last capacity events so jank can be told apart from idleness
+// after the fact. Each renderer target and view backend owns one.
+//
+// Timelines only exist with WPE_RDK_FRAME_TIMELINE set: create() returns
+// null otherwise, and the hooks record through a null check, so a disabled
+// timeline costs one branch per event. The value of WPE_RDK_FRAME_TIMELINE
+// is how often, in seconds, report() is printed to stderr, 5 by default. The
+// last report is printed when the timeline goes away.
+//
+// record() may run on any thread and does not lock: an event takes its slot
+// with an atomic increment and is stored as a single word. report() reads
+// the ring without stopping writers and drops what was overwritten while it
+// read.
+class FrameTimeline {
+public:
+    enum Event : uint8_t {
+        // The frame_will_render and frame_rendered hooks of a renderer.
+        WillRender,
+        Rendered,
+        // A BufferCommit reaching the view backend, and the FrameComplete
+        // for it, when the view backend sends it and when the renderer
+        // dispatches it.
+        BufferCommit,
+        FrameComplete,
+        // wpe_view_backend_dispatch_frame_displayed().
+        FrameDisplayed,
+    };
+
+    static const unsigned capacity = 1024;
+
+    // frameEvent is the event that marks one frame on this timeline, e.g.
+    // Rendered for a renderer target and FrameDisplayed for a view backend.
+    static std::unique_ptr<FrameTimeline> create(const char* name, Event frameEvent);
+
+    // A report interval of 0 only reports on destruction.
+    FrameTimeline(const char* name, Event frameEvent, uint64_t reportInterval);
+    ~FrameTimeline();
+
+    void record(Event);
+    void record(Event, uint64_t timestamp);
+
+    // The display refresh interval in nanoseconds that missed vsyncs are
+    // counted against, 60Hz unless the backend knows better.
+    void setRefreshInterval(uint64_t);
+
+    struct Report {
+        void print(const char* name) const;
+
+        uint64_t frames { 0 };
+        // Frames per second over the intervals below, i.e. while frames were
+        // being produced.
+        double fps { 0 };
+        // Refreshes that went by without a frame between two frames.
+        uint64_t missedVSyncs { 0 };
+        // Intervals between consecutive frames, in nanoseconds. Gaps longer
+        // than idleInterval are idleness rather than jank and left out.
+        uint64_t p50 { 0 };
+        uint64_t p95 { 0 };
+        uint64_t p99 { 0 };
+        uint64_t maxInterval { 0 };
+        // From frame_will_render to frame_rendered, and from BufferCommit
+        // to the FrameComplete that follows, on average.
+        uint64_t renderTime { 0 };
+        uint64_t completeLatency { 0 };
+    };
+
+    static const uint64_t idleInterval = 250000000;
+
+    // Covers the events recorded since the given CLOCK_MONOTONIC time, all
+    // that are still in the ring by default.
+    Report report(uint64_t since = 0) const;
+
+private:
+    void maybeReport(uint64_t timestamp);
+
+    const char* m_name;
+    Event m_frameEvent;
+    uint64_t m_reportInterval;
+    std::atomic<uint64_t> m_refreshInterval;
+
+    // Events are stored as timestamp << eventBits | event.
+    static const unsigned eventBits = 3;
+    std::array<std::atomic<uint64_t>, capacity> m_events;
+    std::atomic<uint64_t> m_head { 0 };
+
+    std::atomic<uint64_t> m_lastReport;
+};
+
+} // namespace WPE
+
+#endif // wpe_platform_frame_timeline_h
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_ipc_flow_policy_h
+#define wpe_platform_ipc_flow_policy_h
+
+#include "ipc.h"
+#include "ipc-message.h"
+#include <wpe/wpe.h>
+
+namespace IPC {
+
+// Flow policy for the input a renderer backend forwards to the view process:
+// pointer motion sent with the backend's pointerCode may be coalesced when
+// the view process falls behind, everything else is queued.
+template<uint64_t pointerCode>
+FlowAction coalescePointerMotion(const Message& message)
+{
+    if (message.messageCode == pointerCode) {
+        auto event = decode<MessageOf<pointerCode, wpe_input_pointer_event>>(message);
+        if (event.data.type == wpe_input_pointer_event_type_motion)
+            return FlowAction::Coalesce;
+    }
+    return FlowAction::Queue;
+}
+
+} // namespace IPC
+
+#endif // wpe_platform_ipc_flow_policy_h
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_ipc_message_h
+#define wpe_platform_ipc_message_h
+
+#include "ipc.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace IPC {
+
+// A message type is a trivially copyable struct that names its code and fits
+// into the message data, e.g.
+//
+//     struct BufferCommit {
+//         static const uint64_t code = 1;
+//
+//         uint32_t width;
+//         uint32_t height;
+//     };
+//
+// encode() and decode() copy it into and out of a Message. Nothing is accessed
+// through a cast pointer, and the copies compile down to plain loads and stores.
+template<typename T>
+struct MessageTypeCheck {
+    static_assert(std::is_trivially_copyable<T>::value, "Message types have to be trivially copyable");
+    static_assert(sizeof(T) <= Message::dataSize, "Message type does not fit into the message data");
+    static const bool value = true;
+};
+
+template<typename T>
+void encode(Message& message, const T& data)
+{
+    static_assert(MessageTypeCheck<T>::value, "");
+    message.messageCode = T::code;
+    memcpy(message.messageData, &data, sizeof(T));
+    memset(message.messageData + sizeof(T), 0, Message::dataSize - sizeof(T));
+}
+
+template<typename T>
+T decode(const Message& message)
+{
+    static_assert(MessageTypeCheck<T>::value, "");
+    T data;
+    memcpy(&data, message.messageData, sizeof(T));
+    return data;
+}
+
+// Turns a struct defined elsewhere, e.g. a wpe_input event, into a message type.
+template<uint64_t Code, typename Data>
+struct MessageOf {
+    static const uint64_t code = Code;
+
+    Data data;
+};
+
+namespace Detail {
+
+template<typename Receiver>
+using DispatchEntry = void (*)(Receiver&, const Message&);
+
+template<typename Receiver, size_t Size>
+struct DispatchTable {
+    DispatchEntry<Receiver> entries[Size];
+};
+
+template<typename Receiver, typename T>
+void dispatchDecoded(Receiver& receiver, const Message& message)
+{
+    receiver.handle(decode<T>(message));
+}
+
+template<size_t Count>
+constexpr bool codesAreUnique(const uint64_t (&codes)[Count])
+{
+    for (size_t i = 0; i < Count; ++i) {
+        for (size_t j = i + 1; j < Count; ++j) {
+            if (codes[i] == codes[j])
+                return false;
+        }
+    }
+    return true;
+}
+
+template<typename Receiver, size_t Size, typename... Types>
+constexpr DispatchTable<Receiver, Size> buildDispatchTable(uint64_t minCode)
+{
+    DispatchTable<Receiver, Size> table { };
+    const uint64_t codes[] = { Types::code... };
+    const DispatchEntry<Receiver> entries[] = { &dispatchDecoded<Receiver, Types>... };
+    for (size_t i = 0; i < sizeof...(Types); ++i)
+        table.entries[codes[i] - minCode] = entries[i];
+    return table;
+}
+
+} // namespace Detail
+
+// Dispatches the messages of the given types to the matching
+// Receiver::handle(const T&) overload. The table indexed by code is built at
+// compile time, so finding the handler is a bounds check and an indirect call,
+// whatever the number of types. dispatch() returns false for any other code.
+template<typename Receiver, typename... Types>
+class MessageRegistry {
+public:
+    static bool dispatch(Receiver& receiver, const Message& message)
+    {
+        uint64_t index = message.messageCode - minCode;
+        if (index >= tableSize || !table.entries[index])
+            return false;
+        table.entries[index](receiver, message);
+        return true;
+    }
+
+private:
+    static constexpr uint64_t codes[] = { Types::code... };
+    static_assert(Detail::codesAreUnique(codes), "Message types have to use distinct codes");
+
+    static constexpr uint64_t minCode = std::min({ Types::code... });
+    static constexpr uint64_t maxCode = std::max({ Types::code... });
+    static constexpr size_t tableSize = maxCode - minCode + 1;
+    static_assert(tableSize <= 256, "Message codes are too far apart for a dispatch table");
+
+    using Table = Detail::DispatchTable<Receiver, tableSize>;
+    static constexpr Table table = Detail::buildDispatchTable<Receiver, tableSize, Types...>(minCode);
+};
+
+template<typename Receiver, typename... Types>
+constexpr uint64_t MessageRegistry<Receiver, Types...>::codes[];
+
+template<typename Receiver, typename... Types>
+constexpr typename MessageRegistry<Receiver, Types...>::Table MessageRegistry<Receiver, Types...>::table;
+
+} // namespace IPC
+
+#endif // wpe_platform_ipc_message_h
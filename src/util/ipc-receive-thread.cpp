@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ipc-receive-thread.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <glib-unix.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace IPC {
+
+std::unique_ptr<ReceiveThread> ReceiveThread::create(DispatchFunction dispatch, void* data)
+{
+    int wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int spaceFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd == -1 || spaceFd == -1) {
+        fprintf(stderr, "IPC::ReceiveThread: failed to create the wake-up eventfds (%s)\n", strerror(errno));
+        if (wakeFd != -1)
+            close(wakeFd);
+        if (spaceFd != -1)
+            close(spaceFd);
+        return nullptr;
+    }
+
+    return std::unique_ptr<ReceiveThread>(new ReceiveThread(dispatch, data, wakeFd, spaceFd));
+}
+
+ReceiveThread::ReceiveThread(DispatchFunction dispatch, void* data, int wakeFd, int spaceFd)
+    : m_dispatch(dispatch)
+    , m_dispatchData(data)
+    , m_context(g_main_context_new())
+    , m_loop(g_main_loop_new(m_context, FALSE))
+    , m_wakeFd(wakeFd)
+    , m_spaceFd(spaceFd)
+{
+    m_wakeSource = g_unix_fd_source_new(m_wakeFd, G_IO_IN);
+    g_source_set_callback(m_wakeSource, reinterpret_cast<GSourceFunc>(wakeCallback), this, nullptr);
+    g_source_set_priority(m_wakeSource, G_PRIORITY_HIGH + 30);
+    g_source_set_can_recurse(m_wakeSource, TRUE);
+    g_source_attach(m_wakeSource, g_main_context_get_thread_default());
+}
+
+ReceiveThread::~ReceiveThread()
+{
+    stop();
+
+    g_source_destroy(m_wakeSource);
+    g_source_unref(m_wakeSource);
+    close(m_wakeFd);
+    close(m_spaceFd);
+
+    for (auto& slot : m_slots)
+        g_free(slot.data);
+
+    g_main_loop_unref(m_loop);
+    g_main_context_unref(m_context);
+}
+
+void ReceiveThread::start()
+{
+    if (m_thread)
+        return;
+
+    m_stopping = false;
+    m_thread = g_thread_new("WPEIPCReceive", threadFunction, this);
+}
+
+void ReceiveThread::stop()
+{
+    if (!m_thread)
+        return;
+
+    // The owner drains no more, so a push() waiting for room has to give up
+    // for the thread to get back to its main loop.
+    m_stopping.store(true, std::memory_order_seq_cst);
+    signal(m_spaceFd);
+    g_main_loop_quit(m_loop);
+    g_thread_join(m_thread);
+    m_thread = nullptr;
+}
+
+gpointer ReceiveThread::threadFunction(gpointer data)
+{
+    auto& thread = *static_cast<ReceiveThread*>(data);
+
+    g_main_context_push_thread_default(thread.m_context);
+    g_main_loop_run(thread.m_loop);
+    g_main_context_pop_thread_default(thread.m_context);
+    return nullptr;
+}
+
+void ReceiveThread::push(const char* data, size_t size)
+{
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+
+    // A full queue means the owner is busy; stop reading until it catches
+    // up, which leaves the backpressure to the socket as before. The owner
+    // signals room once it drained, stop() signals it too.
+    while (tail - m_head.load(std::memory_order_seq_cst) == capacity) {
+        if (m_stopping.load(std::memory_order_seq_cst))
+            return;
+
+        m_producerWaiting.store(true, std::memory_order_seq_cst);
+        if (tail - m_head.load(std::memory_order_seq_cst) != capacity)
+            break;
+
+        signal(m_wakeFd);
+        struct pollfd pollFd = { m_spaceFd, POLLIN, 0 };
+        while (poll(&pollFd, 1, -1) == -1 && errno == EINTR) { }
+
+        uint64_t value;
+        while (read(m_spaceFd, &value, sizeof(value)) == -1 && errno == EINTR) { }
+    }
+    m_producerWaiting.store(false, std::memory_order_relaxed);
+
+    auto& slot = m_slots[tail % capacity];
+    if (size <= Message::size) {
+        memcpy(Message::data(slot.message), data, size);
+    } else {
+        slot.data = static_cast<char*>(g_malloc(size));
+        memcpy(slot.data, data, size);
+    }
+    slot.size = size;
+
+    m_tail.store(tail + 1, std::memory_order_seq_cst);
+    if (m_head.load(std::memory_order_seq_cst) == tail)
+        signal(m_wakeFd);
+}
+
+void ReceiveThread::signal(int fd)
+{
+    uint64_t value = 1;
+    while (write(fd, &value, sizeof(value)) == -1 && errno == EINTR) { }
+}
+
+void ReceiveThread::waitForMessages()
+{
+    struct pollfd pollFd = { m_wakeFd, POLLIN, 0 };
+    while (m_head.load(std::memory_order_seq_cst) == m_tail.load(std::memory_order_seq_cst)) {
+        if (poll(&pollFd, 1, -1) == -1 && errno != EINTR)
+            break;
+    }
+}
+
+void ReceiveThread::drain()
+{
+    uint64_t value;
+    while (read(m_wakeFd, &value, sizeof(value)) == -1 && errno == EINTR) { }
+
+    // The slot is released before dispatching, since handlers may drain
+    // again from within, e.g. through Client::readSynchronously().
+    for (;;) {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_seq_cst))
+            break;
+
+        auto& slot = m_slots[head % capacity];
+        Message message = slot.message;
+        char* data = slot.data;
+        size_t size = slot.size;
+        slot.data = nullptr;
+        m_head.store(head + 1, std::memory_order_seq_cst);
+        if (m_producerWaiting.exchange(false, std::memory_order_seq_cst))
+            signal(m_spaceFd);
+
+        m_dispatch(data ? data : Message::data(message), size, m_dispatchData);
+        g_free(data);
+    }
+}
+
+gboolean ReceiveThread::wakeCallback(gint, GIOCondition, gpointer data)
+{
+    static_cast<ReceiveThread*>(data)->drain();
+    return G_SOURCE_CONTINUE;
+}
+
+} // namespace IPC
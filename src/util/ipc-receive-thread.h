@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_ipc_receive_thread_h
+#define wpe_platform_ipc_receive_thread_h
+
+#include "ipc.h"
+
+#include <atomic>
+#include <glib.h>
+#include <memory>
+#include <stdint.h>
+
+namespace IPC {
+
+// Runs a GMainContext of its own on a separate thread. Messages received
+// there are handed to the owning context through a single-producer/
+// single-consumer queue; an eventfd wakes the owner only when the queue
+// was empty, so a burst costs one main loop wakeup.
+class ReceiveThread {
+public:
+    using DispatchFunction = void (*)(char*, size_t, void*);
+
+    static std::unique_ptr<ReceiveThread> create(DispatchFunction, void*);
+    ~ReceiveThread();
+
+    GMainContext* context() const { return m_context; }
+
+    void start();
+    void stop();
+
+    // Receive thread only.
+    void push(const char*, size_t);
+
+    // Owning thread only.
+    void waitForMessages();
+    void drain();
+
+private:
+    static const uint32_t capacity = 256;
+
+    struct Slot {
+        Message message;
+        // Messages with a payload are copied to the heap as a whole.
+        char* data { nullptr };
+        size_t size { 0 };
+    };
+
+    ReceiveThread(DispatchFunction, void*, int, int);
+
+    static void signal(int);
+
+    static gpointer threadFunction(gpointer);
+    static gboolean wakeCallback(gint, GIOCondition, gpointer);
+
+    DispatchFunction m_dispatch;
+    void* m_dispatchData;
+
+    GMainContext* m_context;
+    GMainLoop* m_loop;
+    GThread* m_thread { nullptr };
+
+    int m_wakeFd;
+    GSource* m_wakeSource;
+    // Wakes the receive thread when it waits for room in a full queue.
+    int m_spaceFd;
+    std::atomic<bool> m_producerWaiting { false };
+    std::atomic<bool> m_stopping { false };
+
+    // The slots keep the consumer and producer indices on separate cache lines.
+    std::atomic<uint32_t> m_head { 0 };
+    Slot m_slots[capacity];
+    std::atomic<uint32_t> m_tail { 0 };
+};
+
+} // namespace IPC
+
+#endif // wpe_platform_ipc_receive_thread_h
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ipc-recorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace IPC {
+
+// Messages replayed per main loop iteration when running as fast as possible.
+static const unsigned replayBatch = 64;
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static size_t recordSize(size_t size)
+{
+    return sizeof(Trace::RecordHeader) + ((size + 7) & ~static_cast<size_t>(7));
+}
+
+std::unique_ptr<Recorder> Recorder::create(const char* role)
+{
+    const char* prefix = std::getenv("WPE_IPC_RECORD");
+    if (!prefix || !*prefix)
+        return nullptr;
+
+    static std::atomic<unsigned> s_instance { 0 };
+    std::string path = std::string(prefix) + '.' + role + '.' + std::to_string(getpid()) + '.' + std::to_string(s_instance++);
+
+    FILE* file = fopen(path.c_str(), "wbe");
+    if (!file) {
+        fprintf(stderr, "IPC::Recorder: cannot open %s (%s)\n", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    Trace::FileHeader header = { };
+    memcpy(header.magic, Trace::magic, sizeof(header.magic));
+    header.version = Trace::version;
+    fwrite(&header, sizeof(header), 1, file);
+
+    return std::unique_ptr<Recorder>(new Recorder(file));
+}
+
+Recorder::Recorder(FILE* file)
+    : m_file(file)
+{
+}
+
+Recorder::~Recorder()
+{
+    fclose(m_file);
+}
+
+void Recorder::record(Trace::Direction direction, const char* data, size_t size)
+{
+    record(direction, Message::cast(const_cast<char*>(data)), data + Message::size, size - Message::size);
+}
+
+void Recorder::record(Trace::Direction direction, const Message& message, const void* payload, size_t payloadSize)
+{
+    size_t size = Message::size + payloadSize;
+
+    Trace::RecordHeader header = { };
+    header.timestamp = monotonicTime();
+    header.size = size;
+    header.direction = direction;
+
+    static const char padding[8] = { };
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    fwrite(&header, sizeof(header), 1, m_file);
+    fwrite(std::addressof(message), Message::size, 1, m_file);
+    if (payloadSize)
+        fwrite(payload, payloadSize, 1, m_file);
+    fwrite(padding, recordSize(size) - sizeof(header) - size, 1, m_file);
+}
+
+GSourceFuncs Replayer::sourceFuncs = {
+    nullptr, // prepare
+    nullptr, // check
+    // dispatch
+    [](GSource*, GSourceFunc callback, gpointer userData) -> gboolean
+    {
+        return callback(userData);
+    },
+    nullptr, // finalize
+    nullptr, // closure_callback
+    nullptr, // closure_marshall
+};
+
+std::unique_ptr<Replayer> Replayer::create(const char* path, double speed, Sink sink, void* sinkData)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "IPC::Replayer: cannot open %s (%s)\n", path, strerror(errno));
+        return nullptr;
+    }
+
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &status) != -1 && static_cast<size_t>(status.st_size) >= sizeof(Trace::FileHeader))
+        mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "IPC::Replayer: cannot map %s\n", path);
+        return nullptr;
+    }
+
+    auto& header = *static_cast<const Trace::FileHeader*>(mapping);
+    if (memcmp(header.magic, Trace::magic, sizeof(header.magic)) || header.version != Trace::version) {
+        fprintf(stderr, "IPC::Replayer: %s is not a trace\n", path);
+        munmap(mapping, status.st_size);
+        return nullptr;
+    }
+
+    return std::unique_ptr<Replayer>(new Replayer(static_cast<const char*>(mapping), status.st_size, std::max(speed, 0.0), sink, sinkData));
+}
+
+Replayer::Replayer(const char* data, size_t size, double speed, Sink sink, void* sinkData)
+    : m_data(data)
+    , m_size(size)
+    , m_speed(speed)
+    , m_sink(sink)
+    , m_sinkData(sinkData)
+{
+    m_source = g_source_new(&sourceFuncs, sizeof(GSource));
+    g_source_set_name(m_source, "[WPE] IPC replay");
+    g_source_set_callback(m_source, [](gpointer data) -> gboolean {
+        auto& replayer = *static_cast<Replayer*>(data);
+
+        unsigned count = 0;
+        while (replayer.replayNext() && (replayer.m_speed || ++count < replayBatch)) { }
+        replayer.scheduleNext();
+        return G_SOURCE_CONTINUE;
+    }, this, nullptr);
+    g_source_set_priority(m_source, G_PRIORITY_DEFAULT);
+    g_source_attach(m_source, g_main_context_get_thread_default());
+
+    m_replayStart = g_get_monotonic_time();
+    scheduleNext();
+}
+
+Replayer::~Replayer()
+{
+    g_source_destroy(m_source);
+    g_source_unref(m_source);
+    munmap(const_cast<char*>(m_data), m_size);
+}
+
+// Returns true if a message was handed to the sink and the next one is due.
+bool Replayer::replayNext()
+{
+    while (m_offset + sizeof(Trace::RecordHeader) <= m_size) {
+        Trace::RecordHeader header;
+        memcpy(&header, m_data + m_offset, sizeof(header));
+        if (m_offset + recordSize(header.size) > m_size)
+            break;
+
+        if (header.direction != Trace::Received) {
+            m_offset += recordSize(header.size);
+            continue;
+        }
+
+        if (!m_traceStart)
+            m_traceStart = header.timestamp;
+        if (m_speed) {
+            gint64 due = m_replayStart + (header.timestamp - m_traceStart) / 1000 / m_speed;
+            if (due > g_get_monotonic_time())
+                return false;
+        }
+
+        // Handlers may write to the message, so hand out a copy.
+        m_buffer.assign(m_data + m_offset + sizeof(header), m_data + m_offset + sizeof(header) + header.size);
+        m_offset += recordSize(header.size);
+
+        gint64 start = g_get_monotonic_time();
+        m_sink(m_buffer.data(), m_buffer.size(), m_sinkData);
+        gint64 elapsed = g_get_monotonic_time() - start;
+
+        ++m_replayed;
+        m_handlerTime += elapsed;
+        m_maxHandlerTime = std::max(m_maxHandlerTime, elapsed);
+        return true;
+    }
+
+    finish();
+    return false;
+}
+
+void Replayer::scheduleNext()
+{
+    if (m_offset >= m_size) {
+        g_source_set_ready_time(m_source, -1);
+        return;
+    }
+
+    if (!m_speed || !m_traceStart) {
+        g_source_set_ready_time(m_source, 0);
+        return;
+    }
+
+    Trace::RecordHeader header;
+    memcpy(&header, m_data + m_offset, sizeof(header));
+    g_source_set_ready_time(m_source, m_replayStart + (header.timestamp - m_traceStart) / 1000 / m_speed);
+}
+
+void Replayer::finish()
+{
+    if (m_offset >= m_size)
+        return;
+    m_offset = m_size;
+
+    fprintf(stderr, "IPC::Replayer: replayed %llu messages in %.1fms, handler time %.1fms total, %.1fus average, %lldus max\n",
+        static_cast<unsigned long long>(m_replayed), (g_get_monotonic_time() - m_replayStart) / 1000.0,
+        m_handlerTime / 1000.0, m_replayed ? static_cast<double>(m_handlerTime) / m_replayed : 0.0,
+        static_cast<long long>(m_maxHandlerTime));
+}
+
+} // namespace IPC
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_ipc_recorder_h
+#define wpe_platform_ipc_recorder_h
+
+#include "ipc.h"
+
+#include <cstdio>
+#include <glib.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+namespace IPC {
+
+// Trace files are a FileHeader followed by records, each a RecordHeader and
+// the message bytes padded to eight bytes, so a mapped trace can be walked in
+// place. Timestamps are CLOCK_MONOTONIC nanoseconds.
+namespace Trace {
+
+static const char magic[8] = { 'W', 'P', 'E', 'I', 'P', 'C', 'T', 'R' };
+static const uint32_t version = 1;
+
+enum Direction : uint8_t {
+    Received = 0,
+    Sent = 1,
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+static_assert(sizeof(FileHeader) == 16, "FileHeader is of correct size");
+
+struct RecordHeader {
+    uint64_t timestamp;
+    uint32_t size;
+    uint8_t direction;
+    uint8_t padding[3];
+};
+static_assert(sizeof(RecordHeader) == 16, "RecordHeader is of correct size");
+
+} // namespace Trace
+
+// Writes every message going through an IPC::Host or IPC::Client to
+// $WPE_IPC_RECORD.<role>.<pid>.<n>, one file per instance.
+class Recorder {
+public:
+    static std::unique_ptr<Recorder> create(const char* role);
+    ~Recorder();
+
+    void record(Trace::Direction, const char*, size_t);
+    // A message followed by its payload, recorded as a single message.
+    void record(Trace::Direction, const Message&, const void* payload, size_t payloadSize);
+
+private:
+    explicit Recorder(FILE*);
+
+    // Sending and receiving may happen on different threads.
+    std::mutex m_mutex;
+    FILE* m_file;
+};
+
+// Feeds the received messages of a trace into a handler from the main loop,
+// either at the recorded pace divided by speed, or as fast as possible when
+// speed is 0, then prints how long the handler took.
+class Replayer {
+public:
+    using Sink = void (*)(char*, size_t, void*);
+
+    static std::unique_ptr<Replayer> create(const char* path, double speed, Sink, void*);
+    ~Replayer();
+
+private:
+    Replayer(const char*, size_t, double, Sink, void*);
+
+    static GSourceFuncs sourceFuncs;
+
+    bool replayNext();
+    void scheduleNext();
+    void finish();
+
+    const char* m_data;
+    size_t m_size;
+    size_t m_offset { sizeof(Trace::FileHeader) };
+    double m_speed;
+    Sink m_sink;
+    void* m_sinkData;
+
+    GSource* m_source;
+    uint64_t m_traceStart { 0 };
+    gint64 m_replayStart { 0 };
+    std::vector<char> m_buffer;
+
+    uint64_t m_replayed { 0 };
+    gint64 m_handlerTime { 0 };
+    gint64 m_maxHandlerTime { 0 };
+};
+
+} // namespace IPC
+
+#endif // wpe_platform_ipc_recorder_h
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ipc-ring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace IPC {
+
+static const uint32_t ringMagic = 0x57504552; // 'WPER'
+static const uint32_t ringVersion = 2;
+
+struct Ring::Shared {
+    struct Queue {
+        alignas(64) std::atomic<uint32_t> head;
+        alignas(64) std::atomic<uint32_t> tail;
+        // Messages the producer sent through the socket while the ring was
+        // full, and how many of them the consumer has dispatched so far.
+        alignas(64) std::atomic<uint32_t> divertedSent;
+        alignas(64) std::atomic<uint32_t> divertedReceived;
+        alignas(64) uint8_t slots[slotCount][Message::size];
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    // Index 0 carries host-to-client messages, index 1 client-to-host ones.
+    Queue queues[2];
+};
+
+static_assert((Ring::slotCount & (Ring::slotCount - 1)) == 0, "Ring slot count is a power of two");
+
+static int createMemfd(const char* name)
+{
+#if defined(__NR_memfd_create)
+    return syscall(__NR_memfd_create, name, MFD_CLOEXEC);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+std::unique_ptr<Ring> Ring::create()
+{
+    int fds[fdCount] = { -1, -1, -1 };
+
+    fds[0] = createMemfd("wpe-ipc-ring");
+    if (fds[0] == -1 || ftruncate(fds[0], sizeof(Shared)) == -1) {
+        fprintf(stderr, "IPC::Ring: failed to create the shared memory (%s)\n", strerror(errno));
+        if (fds[0] != -1)
+            close(fds[0]);
+        return nullptr;
+    }
+
+    void* mapping = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    fds[2] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mapping == MAP_FAILED || fds[1] == -1 || fds[2] == -1) {
+        fprintf(stderr, "IPC::Ring: failed to set up the ring (%s)\n", strerror(errno));
+        if (mapping != MAP_FAILED)
+            munmap(mapping, sizeof(Shared));
+        for (int fd : fds) {
+            if (fd != -1)
+                close(fd);
+        }
+        return nullptr;
+    }
+
+    auto* shared = new (mapping) Shared();
+    shared->magic = ringMagic;
+    shared->version = ringVersion;
+
+    return std::unique_ptr<Ring>(new Ring(shared, fds));
+}
+
+std::unique_ptr<Ring> Ring::adopt(const int fds[fdCount])
+{
+    struct stat status;
+    if (fstat(fds[0], &status) == -1 || static_cast<size_t>(status.st_size) != sizeof(Shared)) {
+        fprintf(stderr, "IPC::Ring: shared memory has an unexpected size\n");
+        return nullptr;
+    }
+
+    void* mapping = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "IPC::Ring: failed to map the shared memory (%s)\n", strerror(errno));
+        return nullptr;
+    }
+
+    auto* shared = static_cast<Shared*>(mapping);
+    if (shared->magic != ringMagic || shared->version != ringVersion) {
+        fprintf(stderr, "IPC::Ring: shared memory has an unexpected layout\n");
+        munmap(mapping, sizeof(Shared));
+        return nullptr;
+    }
+
+    return std::unique_ptr<Ring>(new Ring(shared, fds));
+}
+
+Ring::Ring(Shared* shared, const int fds[fdCount])
+    : m_shared(shared)
+{
+    std::copy(fds, fds + fdCount, m_fds);
+}
+
+Ring::~Ring()
+{
+    munmap(m_shared, sizeof(Shared));
+    for (int fd : m_fds)
+        close(fd);
+}
+
+bool Ring::push(Side side, const Message& message)
+{
+    auto& queue = m_shared->queues[side == Side::Host ? 0 : 1];
+    int peerDoorbell = m_fds[side == Side::Host ? 2 : 1];
+    uint64_t value = 1;
+
+    // Once messages went through the socket, later ones follow them there
+    // until the consumer has dispatched all of them, or they could overtake.
+    uint32_t divertedSent = queue.divertedSent.load(std::memory_order_relaxed);
+    if (divertedSent != queue.divertedReceived.load(std::memory_order_acquire)) {
+        queue.divertedSent.store(divertedSent + 1, std::memory_order_relaxed);
+        ++m_statistics.diverted;
+        return false;
+    }
+
+    uint32_t tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail - queue.head.load(std::memory_order_acquire) == slotCount) {
+        // The consumer is behind. Make sure it is awake and hand the message
+        // back to the caller: the socket blocks once the consumer is that far
+        // behind, which is the backpressure the sender needs.
+        ++m_statistics.overflows;
+        if (write(peerDoorbell, &value, sizeof(value)) == sizeof(value))
+            ++m_statistics.doorbells;
+
+        queue.divertedSent.store(divertedSent + 1, std::memory_order_relaxed);
+        ++m_statistics.diverted;
+        return false;
+    }
+
+    memcpy(queue.slots[tail % slotCount], std::addressof(message), Message::size);
+    queue.tail.store(tail + 1, std::memory_order_seq_cst);
+    ++m_statistics.pushed;
+
+    // Only ring when the consumer had drained everything before this message,
+    // otherwise it is still draining and will pick it up without a wakeup.
+    if (queue.head.load(std::memory_order_seq_cst) == tail) {
+        if (write(peerDoorbell, &value, sizeof(value)) == sizeof(value))
+            ++m_statistics.doorbells;
+    }
+    return true;
+}
+
+bool Ring::pop(Side side, Message& message)
+{
+    auto& queue = m_shared->queues[side == Side::Host ? 1 : 0];
+
+    uint32_t head = queue.head.load(std::memory_order_relaxed);
+    if (head == queue.tail.load(std::memory_order_seq_cst))
+        return false;
+
+    memcpy(std::addressof(message), queue.slots[head % slotCount], Message::size);
+    queue.head.store(head + 1, std::memory_order_seq_cst);
+    return true;
+}
+
+void Ring::divertedMessageReceived(Side side)
+{
+    auto& queue = m_shared->queues[side == Side::Host ? 1 : 0];
+    queue.divertedReceived.fetch_add(1, std::memory_order_release);
+}
+
+void Ring::clearDoorbell(Side side)
+{
+    uint64_t value;
+    while (read(doorbell(side), &value, sizeof(value)) == -1 && errno == EINTR) { }
+}
+
+} // namespace IPC
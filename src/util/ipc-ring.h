@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_ipc_ring_h
+#define wpe_platform_ipc_ring_h
+
+#include "ipc.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace IPC {
+
+// Shared-memory transport for fixed-size messages. A memfd holds one
+// single-producer/single-consumer ring per direction; an eventfd per
+// direction is used purely as a doorbell and is only written when the
+// consumer may have gone idle. The socket keeps carrying descriptors and
+// anything that is not a fixed-size message, and takes over while the ring
+// is full.
+class Ring {
+public:
+    enum class Side { Host, Client };
+
+    static const uint32_t slotCount = 256;
+    static const size_t fdCount = 3;
+
+    static std::unique_ptr<Ring> create();
+    static std::unique_ptr<Ring> adopt(const int fds[fdCount]);
+
+    ~Ring();
+
+    // Descriptors to hand over to the client, in the order adopt() expects.
+    const int* fds() const { return m_fds; }
+
+    // Returns false when the message has to go through the socket instead,
+    // because the ring is full or earlier messages went there already.
+    bool push(Side, const Message&);
+    bool pop(Side, Message&);
+
+    // To be called by the consumer for every fixed-size message it dispatches
+    // from the socket, so the producer knows when to come back to the ring.
+    void divertedMessageReceived(Side);
+
+    int doorbell(Side side) const { return m_fds[side == Side::Host ? 1 : 2]; }
+    void clearDoorbell(Side);
+
+    struct Statistics {
+        uint64_t pushed { 0 };
+        uint64_t doorbells { 0 };
+        uint64_t overflows { 0 };
+        uint64_t diverted { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+
+private:
+    struct Shared;
+
+    Ring(Shared*, const int fds[fdCount]);
+
+    Shared* m_shared;
+    int m_fds[fdCount];
+    Statistics m_statistics;
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "Ring indices need address-free atomics");
+
+} // namespace IPC
+
+#endif // wpe_platform_ipc_ring_h
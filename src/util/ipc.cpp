@@ -27,13 +27,562 @@
 
 #include "ipc.h"
 
+#include "ipc-receive-thread.h"
+#include "ipc-recorder.h"
+#include "ipc-ring.h"
+#include "statistics.h"
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
-#include <gio/gunixfdmessage.h>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace IPC {
 
+// Room for the descriptors of a single SCM_RIGHTS control message.
+static const size_t maxReceivedFds = Message::maxFds;
+
+static size_t receiveBatchSize()
+{
+    static size_t batchSize = []() -> size_t {
+        const char* env = std::getenv("WPE_IPC_RECEIVE_BATCH");
+        if (!env)
+            return maxReceiveBatch;
+        return std::min<size_t>(std::max(std::atoi(env), 1), maxReceiveBatch);
+    }();
+    return batchSize;
+}
+
+static void closeFds(const int* fds, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        close(fds[i]);
+}
+
+static bool ringTransportRequested()
+{
+    static bool requested = []() {
+        const char* env = std::getenv("WPE_IPC_TRANSPORT");
+        return env && !strcmp(env, "ring");
+    }();
+    return requested;
+}
+
+static bool receiveThreadRequested()
+{
+    static bool requested = !!std::getenv("WPE_IPC_RECEIVE_THREAD");
+    return requested;
+}
+
+static bool signalsRequested()
+{
+    static bool requested = []() {
+        const char* env = std::getenv("WPE_IPC_SIGNALS");
+        return !env || strcmp(env, "0");
+    }();
+    return requested;
+}
+
+static bool sendSignalTo(int fd)
+{
+    uint64_t value = 1;
+    return fd != -1 && write(fd, &value, sizeof(value)) == sizeof(value);
+}
+
+// Resets the eventfd counter, which is how many signals arrived since.
+static uint64_t receiveSignals(int fd)
+{
+    uint64_t value;
+    return read(fd, &value, sizeof(value)) == sizeof(value) ? value : 0;
+}
+
+// Flow control is on by default: without it a view process that stops
+// reading blocks whichever renderer thread forwards input on a full socket.
+// WPE_IPC_FLOW_CONTROL=0 keeps the plain blocking sends, e.g. to compare.
+static bool flowControlDisabled()
+{
+    static bool disabled = []() {
+        const char* env = std::getenv("WPE_IPC_FLOW_CONTROL");
+        return env && !strcmp(env, "0");
+    }();
+    return disabled;
+}
+
+static bool corkRequested()
+{
+    static bool requested = !!std::getenv("WPE_IPC_CORK") && !ringTransportRequested();
+    return requested;
+}
+
+// Messages kept in flight, and held back, by a flow-controlled client.
+static const size_t defaultFlowHighWater = 128;
+static const size_t maxPendingMessages = 1024;
+
+static size_t flowHighWater()
+{
+    static size_t highWater = []() -> size_t {
+        const char* env = std::getenv("WPE_IPC_FLOW_HIGH_WATER");
+        if (!env)
+            return defaultFlowHighWater;
+        return std::max(std::atoi(env), 1);
+    }();
+    return highWater;
+}
+
+static void printRingStatistics(const char* name, const Ring& ring)
+{
+    auto& statistics = ring.statistics();
+    fprintf(stderr, "%s: ring pushed %llu messages, %llu doorbells, %llu overflows, %llu sent through the socket\n",
+        name, static_cast<unsigned long long>(statistics.pushed), static_cast<unsigned long long>(statistics.doorbells),
+        static_cast<unsigned long long>(statistics.overflows), static_cast<unsigned long long>(statistics.diverted));
+}
+
+// Both the socket and the ring doorbells are watched as plain descriptors,
+// there's no need for a GSocket in between.
+static GSource* createFdSource(int fd, GUnixFDSourceFunc callback, gpointer data, gint priority, GMainContext* context = nullptr)
+{
+    GSource* source = g_unix_fd_source_new(fd, G_IO_IN);
+    g_source_set_callback(source, reinterpret_cast<GSourceFunc>(callback), data, nullptr);
+    g_source_set_priority(source, priority);
+    g_source_set_can_recurse(source, TRUE);
+    g_source_attach(source, context ? context : g_main_context_get_thread_default());
+    return source;
+}
+
+// Reads drain the socket until it would block, sends wait in sendAll().
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+// Payloads are padded on the wire so the next message header stays aligned.
+static size_t paddedPayloadSize(size_t payloadSize)
+{
+    return (payloadSize + alignof(Message) - 1) & ~(alignof(Message) - 1);
+}
+
+// Both ends keep their socket non-blocking for the receive side, so every
+// send has to treat a full socket as "wait", never as "drop": a message or
+// descriptor lost there would never be retried.
+static bool waitUntilWritable(int fd)
+{
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return false;
+
+    struct pollfd pollFd = { fd, POLLOUT, 0 };
+    while (poll(&pollFd, 1, -1) == -1) {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+// Writes the whole vector, waiting for the peer whenever the socket is full.
+static bool sendAll(int fd, struct iovec* vector, size_t count)
+{
+    while (count) {
+        struct msghdr header = { };
+        header.msg_iov = vector;
+        header.msg_iovlen = count;
+
+        ssize_t len = sendmsg(fd, &header, MSG_NOSIGNAL);
+        if (len == -1) {
+            if (errno == EINTR)
+                continue;
+            if (!waitUntilWritable(fd))
+                return false;
+            continue;
+        }
+
+        while (count && static_cast<size_t>(len) >= vector->iov_len) {
+            len -= vector->iov_len;
+            ++vector;
+            --count;
+        }
+        if (count) {
+            vector->iov_base = static_cast<char*>(vector->iov_base) + len;
+            vector->iov_len -= len;
+        }
+    }
+    return true;
+}
+
+static bool sendData(int fd, const char* data, size_t size)
+{
+    struct iovec vector = { const_cast<char*>(data), size };
+    return sendAll(fd, &vector, 1);
+}
+
+// Passes the descriptors along with the message, all of it or nothing.
+static bool sendMessageWithFds(int fd, Message& message, const int* fds, size_t fdCount)
+{
+    struct iovec vector = { Message::data(message), Message::size };
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * Message::maxFds)] = { };
+
+    struct msghdr header = { };
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    if (fdCount) {
+        header.msg_control = control;
+        header.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+
+        struct cmsghdr* controlMessage = CMSG_FIRSTHDR(&header);
+        controlMessage->cmsg_level = SOL_SOCKET;
+        controlMessage->cmsg_type = SCM_RIGHTS;
+        controlMessage->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+        memcpy(CMSG_DATA(controlMessage), fds, sizeof(int) * fdCount);
+    }
+
+    ssize_t len;
+    for (;;) {
+        len = sendmsg(fd, &header, MSG_NOSIGNAL);
+        if (len != -1)
+            break;
+        if (errno == EINTR)
+            continue;
+        if (!waitUntilWritable(fd))
+            return false;
+    }
+
+    // The descriptors went out with the first byte, the rest of the message
+    // may still have to follow.
+    if (static_cast<size_t>(len) < Message::size) {
+        vector.iov_base = Message::data(message) + len;
+        vector.iov_len = Message::size - len;
+        return sendAll(fd, &vector, 1);
+    }
+    return true;
+}
+
+static bool sendMessageWithPayload(int fd, Message& message, const void* payload, size_t payloadSize)
+{
+    if (payloadSize > Message::maxPayloadSize)
+        return false;
+
+    message.messageCode |= Message::payloadFlag;
+    uint32_t size = payloadSize;
+    memcpy(message.messageData, &size, sizeof(size));
+
+    static const char padding[alignof(Message)] = { };
+    struct iovec vector[3] = {
+        { Message::data(message), Message::size },
+        { const_cast<void*>(payload), payloadSize },
+        { const_cast<char*>(padding), paddedPayloadSize(payloadSize) - payloadSize },
+    };
+    bool result = sendAll(fd, vector, 3);
+
+    message.messageCode &= ~Message::payloadFlag;
+    return result;
+}
+
+char* MessageStream::writePosition()
+{
+    if (!m_largeMessage.empty())
+        return m_largeMessage.data() + m_buffered;
+    return m_buffer + m_buffered;
+}
+
+size_t MessageStream::writableSize(size_t limit) const
+{
+    // A large message is read exactly up to its end, it is rare enough not
+    // to bother with whatever follows it.
+    if (!m_largeMessage.empty())
+        return m_largeMessage.size() - m_buffered;
+    return std::min(limit, receiveBufferSize - m_buffered);
+}
+
+template<typename Handler>
+bool MessageStream::received(size_t length, size_t& handled, const Handler& handler)
+{
+    m_buffered += length;
+
+    if (!m_largeMessage.empty()) {
+        if (m_buffered < m_largeMessage.size())
+            return true;
+
+        auto& message = Message::cast(m_largeMessage.data());
+        size_t payloadSize = Message::payloadSize(message);
+        message.messageCode &= ~Message::payloadFlag;
+        handler(m_largeMessage.data(), Message::size + payloadSize);
+        ++handled;
+
+        m_buffered = 0;
+        std::vector<char>().swap(m_largeMessage);
+        return true;
+    }
+
+    size_t offset = 0;
+    while (m_buffered - offset >= Message::size) {
+        auto& message = Message::cast(m_buffer + offset);
+        size_t messageSize = Message::size;
+        size_t payloadSize = 0;
+        if (message.messageCode & Message::payloadFlag) {
+            payloadSize = Message::payloadSize(message);
+            if (payloadSize > Message::maxPayloadSize) {
+                m_buffered = 0;
+                return false;
+            }
+            messageSize += paddedPayloadSize(payloadSize);
+        }
+
+        if (m_buffered - offset < messageSize) {
+            if (messageSize > receiveBufferSize) {
+                m_largeMessage.resize(messageSize);
+                memcpy(m_largeMessage.data(), m_buffer + offset, m_buffered - offset);
+                m_buffered -= offset;
+                return true;
+            }
+            break;
+        }
+
+        message.messageCode &= ~Message::payloadFlag;
+        handler(m_buffer + offset, Message::size + payloadSize);
+        ++handled;
+        offset += messageSize;
+    }
+
+    // Keep the partial message, if any, for the next read.
+    m_buffered -= offset;
+    if (m_buffered && offset)
+        memmove(m_buffer, m_buffer + offset, m_buffered);
+    return true;
+}
+
+void MessageLanes::setClass(uint64_t messageCode, MessageClass messageClass)
+{
+    if (messageCode >= maxInputCode)
+        return;
+
+    uint64_t bit = 1ull << (messageCode % 64);
+    if (messageClass == MessageClass::Input)
+        m_inputCodes[messageCode / 64] |= bit;
+    else
+        m_inputCodes[messageCode / 64] &= ~bit;
+}
+
+MessageClass MessageLanes::classify(uint64_t messageCode) const
+{
+    if (messageCode < maxInputCode && (m_inputCodes[messageCode / 64] & (1ull << (messageCode % 64))))
+        return MessageClass::Input;
+    return MessageClass::Control;
+}
+
+template<typename Handler>
+void MessageLanes::dispatch(char* data, size_t size, gint64 receiveTime, const Handler& handler)
+{
+    if (size != Message::size || classify(Message::cast(data).messageCode) == MessageClass::Control) {
+        record(MessageClass::Control, receiveTime);
+        handler(data, size);
+        return;
+    }
+
+    if (m_inputQueueSize == inputQueueCapacity)
+        flush(handler);
+
+    size_t index = (m_inputQueueHead + m_inputQueueSize) % inputQueueCapacity;
+    memcpy(Message::data(m_inputQueue[index]), data, Message::size);
+    m_inputQueueTimes[index] = receiveTime;
+    ++m_inputQueueSize;
+
+    auto& statistics = m_statistics[static_cast<size_t>(MessageClass::Input)];
+    statistics.maxDepth = std::max(statistics.maxDepth, m_inputQueueSize);
+}
+
+template<typename Handler>
+void MessageLanes::flush(const Handler& handler)
+{
+    // Each entry is taken off the queue before it is handled, as handlers
+    // may receive, and so flush, again from within.
+    while (m_inputQueueSize) {
+        Message message = m_inputQueue[m_inputQueueHead];
+        gint64 receiveTime = m_inputQueueTimes[m_inputQueueHead];
+        m_inputQueueHead = (m_inputQueueHead + 1) % inputQueueCapacity;
+        --m_inputQueueSize;
+
+        record(MessageClass::Input, receiveTime);
+        handler(Message::data(message), Message::size);
+    }
+}
+
+void MessageLanes::record(MessageClass messageClass, gint64 receiveTime)
+{
+    auto& statistics = m_statistics[static_cast<size_t>(messageClass)];
+    ++statistics.messages;
+
+    if (receiveTime) {
+        uint64_t wait = g_get_monotonic_time() - receiveTime;
+        statistics.totalWait += wait;
+        statistics.maxWait = std::max(statistics.maxWait, wait);
+    }
+}
+
+void MessageLanes::print(const char* name) const
+{
+    static const char* classNames[classCount] = { "control", "input" };
+    for (size_t i = 0; i < classCount; ++i) {
+        auto& statistics = m_statistics[i];
+        if (!statistics.messages)
+            continue;
+
+        fprintf(stderr, "%s: %s lane %llu messages, wait %.1fus average, %lluus max, max depth %zu\n",
+            name, classNames[i], static_cast<unsigned long long>(statistics.messages),
+            static_cast<double>(statistics.totalWait) / statistics.messages,
+            static_cast<unsigned long long>(statistics.maxWait), statistics.maxDepth);
+    }
+}
+
+void FlowStatistics::print(const char* name) const
+{
+    if (!backpressureEvents)
+        return;
+
+    fprintf(stderr, "%s: backpressure %llu times, %llu messages queued, %llu coalesced, %llu dropped, max %zu pending\n",
+        name, static_cast<unsigned long long>(backpressureEvents), static_cast<unsigned long long>(queued),
+        static_cast<unsigned long long>(coalesced), static_cast<unsigned long long>(dropped), maxPending);
+}
+
+// Wait times are only measured when they get printed.
+static gint64 receiveTimestamp()
+{
+    return WPE::statisticsEnabled() ? g_get_monotonic_time() : 0;
+}
+
+void ReceiveStatistics::record(size_t handled)
+{
+    ++wakeups;
+    messages += handled;
+    maxMessagesPerWakeup = std::max(maxMessagesPerWakeup, handled);
+
+    size_t bucket = 0;
+    for (size_t count = handled; count && bucket < histogramSize - 1; count >>= 1)
+        ++bucket;
+    ++histogram[bucket];
+}
+
+void ReceiveStatistics::print(const char* name) const
+{
+    if (!wakeups)
+        return;
+
+    fprintf(stderr, "%s: %llu messages in %llu wakeups (%.2f per wakeup, max %zu)"
+        " [0: %llu, 1: %llu, 2-3: %llu, 4-7: %llu, 8-15: %llu, 16+: %llu]\n",
+        name, static_cast<unsigned long long>(messages), static_cast<unsigned long long>(wakeups),
+        static_cast<double>(messages) / wakeups, maxMessagesPerWakeup,
+        static_cast<unsigned long long>(histogram[0]), static_cast<unsigned long long>(histogram[1]),
+        static_cast<unsigned long long>(histogram[2]), static_cast<unsigned long long>(histogram[3]),
+        static_cast<unsigned long long>(histogram[4]), static_cast<unsigned long long>(histogram[5]));
+}
+
+// Flushes in prepare(), i.e. once everything dispatched in the current main
+// loop iteration had its chance to send, and before the loop sleeps.
+struct SendCork::Source {
+    static GSourceFuncs sourceFuncs;
+
+    GSource source;
+    SendCork* cork;
+};
+
+GSourceFuncs SendCork::Source::sourceFuncs = {
+    // prepare
+    [](GSource* base, gint* timeout) -> gboolean
+    {
+        auto& source = *reinterpret_cast<Source*>(base);
+        source.cork->flush();
+        *timeout = -1;
+        return FALSE;
+    },
+    nullptr, // check
+    nullptr, // dispatch
+    nullptr, // finalize
+    nullptr, // closure_callback
+    nullptr, // closure_marshall
+};
+
+void SendCork::enable(int fd)
+{
+    if (m_source)
+        return;
+
+    m_fd = fd;
+    m_source = g_source_new(&Source::sourceFuncs, sizeof(Source));
+    reinterpret_cast<Source*>(m_source)->cork = this;
+    g_source_set_name(m_source, "[WPE] IPC send cork");
+    g_source_attach(m_source, g_main_context_get_thread_default());
+}
+
+void SendCork::disable()
+{
+    if (!m_source)
+        return;
+
+    flush();
+    g_source_destroy(m_source);
+    g_source_unref(m_source);
+    m_source = nullptr;
+    m_fd = -1;
+}
+
+bool SendCork::append(const char* data, size_t size, MessageClass messageClass)
+{
+    if (!m_source || size != Message::size)
+        return false;
+
+    if (m_size == sizeof(m_buffer))
+        flush();
+
+    memcpy(m_buffer + m_size, data, size);
+    m_size += size;
+    ++m_statistics.messages;
+
+    if (messageClass != MessageClass::Input)
+        flush();
+    return true;
+}
+
+void SendCork::flush()
+{
+    if (!m_size)
+        return;
+
+    size_t batch = m_size / Message::size;
+    ++m_statistics.flushes;
+    m_statistics.maxBatch = std::max(m_statistics.maxBatch, batch);
+
+    // Emptied first, since sendData() may wait for the peer.
+    size_t size = m_size;
+    m_size = 0;
+    sendData(m_fd, m_buffer, size);
+}
+
+void SendCork::Statistics::print(const char* name) const
+{
+    if (!flushes)
+        return;
+
+    fprintf(stderr, "%s: corked %llu messages into %llu sends (%.2f per send, max %zu)\n",
+        name, static_cast<unsigned long long>(messages), static_cast<unsigned long long>(flushes),
+        static_cast<double>(messages) / flushes, maxBatch);
+}
+
+void Host::Handler::handleFds(const int* fds, size_t fdCount, char* data, size_t size)
+{
+    if (fdCount)
+        handleFd(fds[0]);
+    closeFds(fds + 1, fdCount ? fdCount - 1 : 0);
+
+    if (Message::cast(data).messageCode != fdTransferCode)
+        handleMessage(data, size);
+}
+
 Host::Host() = default;
 
 void Host::initialize(Handler& handler)
@@ -45,91 +594,417 @@ void Host::initialize(Handler& handler)
     if (ret == -1)
         return;
 
-    m_socket = g_socket_new_from_fd(sockets[0], nullptr);
-    if (!m_socket) {
+    if (!setNonBlocking(sockets[0])) {
         close(sockets[0]);
         close(sockets[1]);
         return;
     }
 
-    m_source = g_socket_create_source(m_socket, G_IO_IN, nullptr);
-    g_source_set_callback(m_source, reinterpret_cast<GSourceFunc>(socketCallback), this, nullptr);
-    g_source_set_priority(m_source, G_PRIORITY_DEFAULT);
-    g_source_set_can_recurse(m_source, TRUE);
-    g_source_attach(m_source, g_main_context_get_thread_default());
-
+    m_socket = sockets[0];
+    m_source = createFdSource(m_socket, socketCallback, this, G_PRIORITY_DEFAULT);
+    if (corkRequested())
+        m_sendCork.enable(m_socket);
     m_clientFd = sockets[1];
+
+    m_recorder = Recorder::create("host").release();
+    if (const char* trace = std::getenv("WPE_IPC_REPLAY")) {
+        const char* speed = std::getenv("WPE_IPC_REPLAY_SPEED");
+        m_replayer = Replayer::create(trace, speed ? std::atof(speed) : 1.0, replayMessage, this).release();
+    }
 }
 
 void Host::deinitialize()
 {
+    if (WPE::statisticsEnabled()) {
+        m_receiveStatistics.print("IPC::Host");
+        m_lanes.print("IPC::Host");
+        m_sendCork.statistics().print("IPC::Host");
+        if (m_ring)
+            printRingStatistics("IPC::Host", *m_ring);
+    }
+    m_sendCork.disable();
+
     if (m_clientFd != -1)
         close(m_clientFd);
 
-    if (m_source)
+    closeReceivedFds();
+
+    delete m_replayer;
+    m_replayer = nullptr;
+    delete m_recorder;
+    m_recorder = nullptr;
+
+    if (m_ringSource) {
+        g_source_destroy(m_ringSource);
+        g_source_unref(m_ringSource);
+        m_ringSource = nullptr;
+    }
+    delete m_ring;
+    m_ring = nullptr;
+
+    if (m_signalSource) {
+        g_source_destroy(m_signalSource);
+        g_source_unref(m_signalSource);
+        m_signalSource = nullptr;
+    }
+    closeFds(&m_incomingSignalFd, 1);
+    closeFds(&m_outgoingSignalFd, 1);
+    m_incomingSignalFd = m_outgoingSignalFd = -1;
+    m_clientOnSignals = m_signalsEnabled = false;
+
+    if (m_source) {
         g_source_destroy(m_source);
-    if (m_socket)
-        g_object_unref(m_socket);
+        g_source_unref(m_source);
+        m_source = nullptr;
+    }
+    if (m_socket != -1) {
+        close(m_socket);
+        m_socket = -1;
+    }
 
     m_handler = nullptr;
 }
 
 int Host::releaseClientFD()
 {
+    if (!m_ring && ringTransportRequested())
+        setUpRing();
+    if (m_signalsEnabled && m_incomingSignalFd == -1)
+        setUpSignals();
+
     return dup(m_clientFd);
 }
 
+void Host::enableSignals()
+{
+    m_signalsEnabled = signalsRequested();
+}
+
+bool Host::setUpSignals()
+{
+    // The client writes to the first one and waits on the second one.
+    int fds[2] = { eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK), eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK) };
+
+    Message message;
+    message.messageCode = signalSetupCode;
+    if (fds[0] == -1 || fds[1] == -1 || !sendMessageWithFds(m_socket, message, fds, 2)) {
+        fprintf(stderr, "IPC::Host: failed to hand over the signal eventfds, staying on the socket\n");
+        closeFds(fds, 2);
+        return false;
+    }
+
+    m_incomingSignalFd = fds[0];
+    m_outgoingSignalFd = fds[1];
+    m_signalSource = createFdSource(m_incomingSignalFd, signalCallback, this, G_PRIORITY_DEFAULT);
+    return true;
+}
+
+bool Host::sendSignal()
+{
+    return m_clientOnSignals && sendSignalTo(m_outgoingSignalFd);
+}
+
+gboolean Host::signalCallback(gint fd, GIOCondition, gpointer data)
+{
+    auto& host = *static_cast<Host*>(data);
+    uint64_t count = receiveSignals(fd);
+    if (count && host.m_handler)
+        host.m_handler->handleSignal(count);
+    return TRUE;
+}
+
+bool Host::setUpRing()
+{
+    std::unique_ptr<Ring> ring = Ring::create();
+    if (!ring)
+        return false;
+
+    // The announcement goes over the socket, so the client sees it after
+    // everything sent so far and before anything that is put into the ring.
+    Message message;
+    message.messageCode = ringSetupCode;
+    uint32_t slotCount = Ring::slotCount;
+    memcpy(message.messageData, &slotCount, sizeof(slotCount));
+
+    if (!sendMessageWithFds(m_socket, message, ring->fds(), Ring::fdCount)) {
+        fprintf(stderr, "IPC::Host: failed to hand over the ring, staying on the socket\n");
+        return false;
+    }
+
+    m_ring = ring.release();
+    m_ringSource = createFdSource(m_ring->doorbell(Ring::Side::Host), ringCallback, this, G_PRIORITY_DEFAULT);
+    return true;
+}
+
 void Host::sendMessage(char* data, size_t size)
 {
-    g_socket_send(m_socket, data, size, nullptr, nullptr);
+    if (m_recorder && size >= Message::size)
+        m_recorder->record(Trace::Sent, data, size);
+
+    if (m_ring && size == Message::size && m_ring->push(Ring::Side::Host, Message::cast(data)))
+        return;
+
+    if (size >= Message::size && m_sendCork.append(data, size, m_lanes.classify(Message::cast(data).messageCode)))
+        return;
+    m_sendCork.flush();
+    sendData(m_socket, data, size);
+}
+
+void Host::sendMessage(Message& message, const void* payload, size_t payloadSize)
+{
+    if (m_recorder)
+        m_recorder->record(Trace::Sent, message, payload, payloadSize);
+
+    m_sendCork.flush();
+    if (!sendMessageWithPayload(m_socket, message, payload, payloadSize))
+        fprintf(stderr, "IPC::Host: failed to send a message with a %zu byte payload\n", payloadSize);
 }
 
-gboolean Host::socketCallback(GSocket* socket, GIOCondition condition, gpointer data)
+gboolean Host::socketCallback(gint, GIOCondition condition, gpointer data)
 {
     if (!(condition & G_IO_IN))
         return TRUE;
 
+    return static_cast<Host*>(data)->receiveFromSocket();
+}
+
+gboolean Host::ringCallback(gint, GIOCondition, gpointer data)
+{
     auto& host = *static_cast<Host*>(data);
 
-    GSocketControlMessage** messages;
-    int nMessages = 0;
-    char* buffer = g_new0(char, Message::size);
-    GInputVector vector = { buffer, Message::size };
-    gssize len = g_socket_receive_message(socket, nullptr, &vector, 1,
-        &messages, &nMessages, nullptr, nullptr, nullptr);
+    // Whatever the client sent before switching over is still in the socket
+    // and has to be handled first to keep the ordering.
+    gboolean result = TRUE;
+    if (!host.m_clientOnRing)
+        result = host.receiveFromSocket();
+    host.receiveFromRing();
+    return result;
+}
 
-    // If nothing is read, give up.
-    if (len == -1) {
-        g_free(buffer);
-        return FALSE;
+gboolean Host::receiveFromSocket()
+{
+    int fd = m_socket;
+    const size_t readLimit = receiveBatchSize() * Message::size;
+    size_t handled = 0;
+    gboolean result = TRUE;
+    gint64 receiveTime = 0;
+
+    auto handle = [this](char* data, size_t size) {
+        deliverMessage(data, size);
+    };
+    auto dispatch = [&](char* data, size_t size) {
+        // Whatever the client sent through the socket while its ring was
+        // full counts here, reserved messages included; only the signal
+        // setup is always written to the socket directly.
+        auto& message = Message::cast(data);
+        if (m_clientOnRing && size == Message::size && !(message.messageCode & Message::fdsFlag) && message.messageCode != signalSetupCode)
+            m_ring->divertedMessageReceived(Ring::Side::Host);
+
+        if (handleReservedMessage(message))
+            return;
+        ++m_handledMessages;
+
+        if (message.messageCode & Message::fdsFlag) {
+            handleMessageWithFds(data, size);
+            return;
+        }
+
+        // Once the client uses the ring, only messages that cannot go
+        // through it arrive here; what it queued before them comes first.
+        if (m_clientOnRing)
+            receiveFromRing();
+        m_lanes.dispatch(data, size, receiveTime, handle);
+    };
+
+    // Drain every queued message in this dispatch instead of one message per
+    // main loop iteration. A batch size of one keeps the single-read behavior.
+    // Messages land in the host-owned buffer and control data on the stack,
+    // so nothing is allocated on this path.
+    while (m_handler) {
+        size_t readSize = m_receiveStream.writableSize(readLimit);
+        struct iovec vector = { m_receiveStream.writePosition(), readSize };
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * maxReceivedFds)];
+
+        struct msghdr header = { };
+        header.msg_iov = &vector;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        ssize_t len = recvmsg(fd, &header, MSG_CMSG_CLOEXEC);
+        if (len == -1) {
+            if (errno == EINTR)
+                continue;
+
+            // If nothing is read, give up, unless the socket is simply drained.
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                result = FALSE;
+            break;
+        }
+        if (!len)
+            break;
+        receiveTime = receiveTimestamp();
+
+        // A read stops right after data that came with descriptors, but may
+        // start with earlier messages or end before the flagged message is
+        // complete. Either way the descriptors belong to the first flagged
+        // message that has not been dispatched yet, which may come with a
+        // later read that brings the next batch along.
+        struct cmsghdr* controlMessage = CMSG_FIRSTHDR(&header);
+        if (controlMessage && controlMessage->cmsg_level == SOL_SOCKET && controlMessage->cmsg_type == SCM_RIGHTS) {
+            size_t fdCount = (controlMessage->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            queueReceivedFds(reinterpret_cast<int*>(CMSG_DATA(controlMessage)), fdCount);
+        }
+
+        if (!m_receiveStream.received(len, handled, dispatch)) {
+            fprintf(stderr, "IPC::Host: malformed message stream\n");
+            result = FALSE;
+            break;
+        }
+
+        if (static_cast<size_t>(len) < readSize || (readLimit == Message::size && handled))
+            break;
     }
 
-    // Safe to assume only one FD message will arrive.
-    if (nMessages == 1 && G_IS_UNIX_FD_MESSAGE(messages[0])) {
-        int* fds;
-        int nFds = 0;
-        fds = g_unix_fd_message_steal_fds(G_UNIX_FD_MESSAGE(messages[0]), &nFds);
+    m_lanes.flush(handle);
+    if (m_flowControlEnabled)
+        sendCredit();
+
+    if (handled || !m_ring)
+        m_receiveStatistics.record(handled);
+    return result;
+}
+
+void Host::receiveFromRing()
+{
+    if (!m_ring)
+        return;
+
+    // Clear the doorbell before draining; a message pushed meanwhile either
+    // gets popped here or rings again.
+    m_ring->clearDoorbell(Ring::Side::Host);
 
-        host.m_handler->handleFd(fds[0]);
+    auto handle = [this](char* data, size_t size) {
+        deliverMessage(data, size);
+    };
 
-        g_free(fds);
+    size_t handled = 0;
+    gint64 receiveTime = receiveTimestamp();
+    Message message;
+    while (m_handler && m_ring->pop(Ring::Side::Host, message)) {
+        if (handleReservedMessage(message))
+            continue;
+
+        m_lanes.dispatch(Message::data(message), Message::size, receiveTime, handle);
+        ++m_handledMessages;
+        ++handled;
     }
+    m_lanes.flush(handle);
 
-    // But just in case, erase any and all messages.
-    if (nMessages > 0) {
-        for (int i = 0; i < nMessages; ++i)
-            g_object_unref(messages[i]);
-        g_free(messages);
+    if (m_flowControlEnabled)
+        sendCredit();
 
-        g_free(buffer);
-        return TRUE;
+    m_receiveStatistics.record(handled);
+}
+
+void Host::deliverMessage(char* data, size_t size)
+{
+    if (m_recorder)
+        m_recorder->record(Trace::Received, data, size);
+    if (m_handler)
+        m_handler->handleMessage(data, size);
+}
+
+void Host::replayMessage(char* data, size_t size, void* userData)
+{
+    auto& host = *static_cast<Host*>(userData);
+    if (host.m_handler)
+        host.m_handler->handleMessage(data, size);
+}
+
+void Host::handleMessageWithFds(char* data, size_t size)
+{
+    Message::cast(data).messageCode &= ~Message::fdsFlag;
+    if (m_recorder)
+        m_recorder->record(Trace::Received, data, size);
+
+    int fds[Message::maxFds];
+    size_t fdCount = 0;
+    if (m_receivedFdBatches) {
+        auto& batch = m_receivedFds[m_receivedFdHead];
+        fdCount = batch.count;
+        memcpy(fds, batch.fds, sizeof(int) * fdCount);
+        m_receivedFdHead = (m_receivedFdHead + 1) % maxReceivedFdBatches;
+        --m_receivedFdBatches;
     }
 
-    if (len == Message::size)
-        host.m_handler->handleMessage(buffer, Message::size);
+    if (m_handler)
+        m_handler->handleFds(fds, fdCount, data, size);
+    else
+        closeFds(fds, fdCount);
+}
 
-    g_free(buffer);
-    return TRUE;
+void Host::queueReceivedFds(const int* fds, size_t fdCount)
+{
+    if (fdCount > maxReceivedFds) {
+        closeFds(fds + maxReceivedFds, fdCount - maxReceivedFds);
+        fdCount = maxReceivedFds;
+    }
+
+    // Only a misbehaving client gets this far ahead; its oldest batch goes.
+    if (m_receivedFdBatches == maxReceivedFdBatches) {
+        fprintf(stderr, "IPC::Host: too many descriptor batches pending, closing the oldest\n");
+        auto& oldest = m_receivedFds[m_receivedFdHead];
+        closeFds(oldest.fds, oldest.count);
+        m_receivedFdHead = (m_receivedFdHead + 1) % maxReceivedFdBatches;
+        --m_receivedFdBatches;
+    }
+
+    auto& batch = m_receivedFds[(m_receivedFdHead + m_receivedFdBatches) % maxReceivedFdBatches];
+    memcpy(batch.fds, fds, sizeof(int) * fdCount);
+    batch.count = fdCount;
+    ++m_receivedFdBatches;
+}
+
+void Host::closeReceivedFds()
+{
+    for (; m_receivedFdBatches; --m_receivedFdBatches) {
+        auto& batch = m_receivedFds[m_receivedFdHead];
+        closeFds(batch.fds, batch.count);
+        m_receivedFdHead = (m_receivedFdHead + 1) % maxReceivedFdBatches;
+    }
+    m_receivedFdHead = 0;
+}
+
+bool Host::handleReservedMessage(const Message& message)
+{
+    switch (message.messageCode) {
+    case ringSetupCode:
+        m_clientOnRing = true;
+        return true;
+    case signalSetupCode:
+        m_clientOnSignals = true;
+        return true;
+    case flowControlCode:
+        m_flowControlEnabled = true;
+        m_handledMessages = m_creditedMessages = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Host::sendCredit()
+{
+    if (m_handledMessages == m_creditedMessages)
+        return;
+
+    // Credits carry the running total, so a lost or merged one does no harm.
+    Message message;
+    message.messageCode = creditCode;
+    memcpy(message.messageData, &m_handledMessages, sizeof(m_handledMessages));
+    sendMessage(Message::data(message), Message::size);
+    m_creditedMessages = m_handledMessages;
 }
 
 Client::Client() = default;
@@ -138,76 +1013,500 @@ void Client::initialize(Handler& handler, int fd)
 {
     m_handler = &handler;
 
-    m_socket = g_socket_new_from_fd(fd, nullptr);
-    if (!m_socket)
+    if (fd == -1 || !setNonBlocking(fd))
         return;
-    g_socket_set_blocking(m_socket, FALSE);
+    m_socket = fd;
+    m_context = g_main_context_ref_thread_default();
 
-    m_source = g_socket_create_source(m_socket, G_IO_IN, nullptr);
-    g_source_set_callback(m_source, reinterpret_cast<GSourceFunc>(socketCallback), this, nullptr);
-    g_source_set_priority(m_source, G_PRIORITY_HIGH + 30);
-    g_source_set_can_recurse(m_source, TRUE);
-    g_source_attach(m_source, g_main_context_get_thread_default());
+    if (receiveThreadRequested())
+        m_receiveThread = ReceiveThread::create(dispatchQueuedMessage, this).release();
+
+    m_source = createFdSource(m_socket, socketCallback, this, G_PRIORITY_HIGH + 30,
+        m_receiveThread ? m_receiveThread->context() : nullptr);
+    // Sending stays on this thread even with a receive thread.
+    if (corkRequested())
+        m_sendCork.enable(m_socket);
+
+    m_recorder = Recorder::create("client").release();
+
+    if (m_receiveThread)
+        m_receiveThread->start();
 }
 
 void Client::deinitialize()
 {
+    // Nothing may be received anymore while the sources go away.
+    if (m_receiveThread)
+        m_receiveThread->stop();
+
+    Ring* ring = m_ring;
+    if (WPE::statisticsEnabled()) {
+        m_receiveStatistics.print("IPC::Client");
+        m_lanes.print("IPC::Client");
+        m_flowStatistics.print("IPC::Client");
+        m_sendCork.statistics().print("IPC::Client");
+        if (ring)
+            printRingStatistics("IPC::Client", *ring);
+    }
+    m_sendCork.disable();
+
+    if (m_ringSource) {
+        g_source_destroy(m_ringSource);
+        g_source_unref(m_ringSource);
+        m_ringSource = nullptr;
+    }
+    m_ring = nullptr;
+    m_sendRing = nullptr;
+    delete ring;
+
+    if (m_signalSource) {
+        g_source_destroy(m_signalSource);
+        g_source_unref(m_signalSource);
+        m_signalSource = nullptr;
+    }
+    closeFds(&m_incomingSignalFd, 1);
+    m_incomingSignalFd = -1;
+    int outgoingSignalFd = m_outgoingSignalFd.exchange(-1);
+    closeFds(&outgoingSignalFd, 1);
+
     if (m_source) {
         g_source_destroy(m_source);
         g_source_unref(m_source);
         m_source = nullptr;
     }
-    if (m_socket) {
-        g_socket_close(m_socket, NULL);
-        g_object_unref(m_socket);
-        m_socket = nullptr;
+    if (m_socket != -1) {
+        close(m_socket);
+        m_socket = -1;
+    }
+
+    delete m_receiveThread;
+    m_receiveThread = nullptr;
+
+    if (m_context) {
+        g_main_context_unref(m_context);
+        m_context = nullptr;
     }
 
+    delete m_recorder;
+    m_recorder = nullptr;
+
     m_handler = nullptr;
 }
 
+void Client::setDirectHandler(uint64_t messageCode, DirectHandler handler, void* data)
+{
+    m_directMessageCode = messageCode;
+    m_directHandler = handler;
+    m_directHandlerData = data;
+}
+
 void Client::readSynchronously()
 {
-    if (g_socket_condition_wait(m_socket, G_IO_IN, nullptr, nullptr))
-        socketCallback(m_socket, G_IO_IN, this);
+    // Whatever is awaited may depend on what is still corked.
+    m_sendCork.flush();
+
+    if (m_receiveThread) {
+        m_receiveThread->waitForMessages();
+        m_receiveThread->drain();
+        return;
+    }
+
+    Ring* ring = m_ring;
+    if (!ring) {
+        struct pollfd pollFd = { m_socket, POLLIN, 0 };
+        while (poll(&pollFd, 1, -1) == -1 && errno == EINTR) { }
+        receiveFromSocket();
+        return;
+    }
+
+    struct pollfd fds[2] = {
+        { m_socket, POLLIN, 0 },
+        { ring->doorbell(Ring::Side::Client), POLLIN, 0 },
+    };
+    while (poll(fds, 2, -1) == -1 && errno == EINTR) { }
+
+    receiveFromSocket();
+    receiveFromRing();
 }
 
-gboolean Client::socketCallback(GSocket* socket, GIOCondition condition, gpointer data)
+gboolean Client::socketCallback(gint, GIOCondition condition, gpointer data)
 {
     if (!(condition & G_IO_IN))
         return TRUE;
 
-    auto& client = *reinterpret_cast<Client*>(data);
+    static_cast<Client*>(data)->receiveFromSocket();
+    return TRUE;
+}
+
+gboolean Client::ringCallback(gint, GIOCondition, gpointer data)
+{
+    auto& client = *static_cast<Client*>(data);
+    client.receiveFromRing();
+    return TRUE;
+}
+
+void Client::dispatchMessage(char* data, size_t size)
+{
+    if (m_recorder)
+        m_recorder->record(Trace::Received, data, size);
+
+    // Credits are accounted for on the thread that sends.
+    if (Message::cast(data).messageCode == creditCode && !m_receiveThread) {
+        handleCredit(Message::cast(data));
+        return;
+    }
+
+    if (m_directHandler && Message::cast(data).messageCode == m_directMessageCode) {
+        m_directHandler(data, size, m_directHandlerData);
+        return;
+    }
+
+    if (m_receiveThread) {
+        m_receiveThread->push(data, size);
+        return;
+    }
+
+    if (m_handler)
+        m_handler->handleMessage(data, size);
+}
+
+void Client::dispatchQueuedMessage(char* data, size_t size, void* userData)
+{
+    auto& client = *static_cast<Client*>(userData);
+    auto& message = Message::cast(data);
+    if (message.messageCode == creditCode) {
+        client.handleCredit(message);
+        return;
+    }
+    if (message.messageCode == ringSetupCode || message.messageCode == signalSetupCode) {
+        client.sendSetupConfirmation(message);
+        return;
+    }
+
+    if (client.m_handler)
+        client.m_handler->handleMessage(data, size);
+}
+
+void Client::adoptRing(const int* fds, size_t fdCount)
+{
+    if (!m_ring && fdCount == Ring::fdCount) {
+        std::unique_ptr<Ring> ring = Ring::adopt(fds);
+        if (ring) {
+            m_ringSource = createFdSource(ring->doorbell(Ring::Side::Client), ringCallback, this, G_PRIORITY_HIGH + 30);
+            m_ring = ring.release();
+
+            // Tell the host that nothing but payload messages and descriptors
+            // will come through the socket anymore.
+            confirmSetup(ringSetupCode);
+            return;
+        }
+    }
+
+    // Without a ring the host keeps using the socket for this client.
+    closeFds(fds, fdCount);
+}
+
+void Client::adoptSignals(const int* fds, size_t fdCount)
+{
+    if (m_incomingSignalFd != -1 || fdCount != 2) {
+        closeFds(fds, fdCount);
+        return;
+    }
+
+    m_incomingSignalFd = fds[1];
+    m_signalSource = createFdSource(m_incomingSignalFd, signalCallback, this, G_PRIORITY_HIGH + 30, m_context);
+    m_outgoingSignalFd = fds[0];
+
+    // The host keeps sending messages until it knows signals are read.
+    confirmSetup(signalSetupCode);
+}
+
+// Only the thread that called initialize() writes to the socket. With a
+// receive thread, where the setup arrived, the confirmation goes through
+// the queue and is sent from sendSetupConfirmation().
+void Client::confirmSetup(uint64_t code)
+{
+    Message message;
+    message.messageCode = code;
+    if (m_receiveThread) {
+        m_receiveThread->push(Message::data(message), Message::size);
+        return;
+    }
+    sendSetupConfirmation(message);
+}
+
+void Client::sendSetupConfirmation(Message& message)
+{
+    // Messages go through the ring only once the host knows to look there.
+    if (message.messageCode == ringSetupCode)
+        m_sendRing = m_ring;
 
-    char* buffer = g_new0(char, Message::size);
-    gssize len = g_socket_receive(socket, buffer, Message::size, nullptr, nullptr);
+    m_sendCork.flush();
+    sendData(m_socket, Message::data(message), Message::size);
+}
 
-    if (len == Message::size)
-        client.m_handler->handleMessage(buffer, Message::size);
+bool Client::sendSignal()
+{
+    // Whatever was sent before the signal should be seen first.
+    m_sendCork.flush();
+    return sendSignalTo(m_outgoingSignalFd);
+}
 
-    g_free(buffer);
+gboolean Client::signalCallback(gint fd, GIOCondition, gpointer data)
+{
+    auto& client = *static_cast<Client*>(data);
+    uint64_t count = receiveSignals(fd);
+    if (count && client.m_handler)
+        client.m_handler->handleSignal(count);
     return TRUE;
 }
 
-void Client::sendFd(int fd)
+void Client::receiveFromSocket()
+{
+    int fd = m_socket;
+    const size_t readLimit = receiveBatchSize() * Message::size;
+    size_t handled = 0;
+    bool ringAdopted = false;
+
+    int receivedFds[maxReceivedFds];
+    size_t receivedFdCount = 0;
+    gint64 receiveTime = 0;
+
+    auto handle = [this](char* data, size_t size) {
+        dispatchMessage(data, size);
+    };
+    auto dispatch = [&](char* data, size_t size) {
+        auto& message = Message::cast(data);
+        if (message.messageCode == ringSetupCode) {
+            adoptRing(receivedFds, receivedFdCount);
+            receivedFdCount = 0;
+            ringAdopted = !!m_ring;
+            return;
+        }
+        if (message.messageCode == signalSetupCode) {
+            adoptSignals(receivedFds, receivedFdCount);
+            receivedFdCount = 0;
+            return;
+        }
+
+        // The host switches to the ring right after announcing it, so any
+        // socket message from then on was sent after what the ring holds.
+        if (Ring* ring = m_ring) {
+            receiveFromRing();
+            if (size == Message::size)
+                ring->divertedMessageReceived(Ring::Side::Client);
+        }
+        m_lanes.dispatch(data, size, receiveTime, handle);
+    };
+
+    while (m_handler) {
+        size_t readSize = m_receiveStream.writableSize(readLimit);
+        struct iovec vector = { m_receiveStream.writePosition(), readSize };
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * maxReceivedFds)];
+
+        struct msghdr header = { };
+        header.msg_iov = &vector;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        ssize_t len = recvmsg(fd, &header, MSG_CMSG_CLOEXEC);
+        if (len == -1 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+        receiveTime = receiveTimestamp();
+
+        struct cmsghdr* controlMessage = CMSG_FIRSTHDR(&header);
+        if (controlMessage && controlMessage->cmsg_level == SOL_SOCKET && controlMessage->cmsg_type == SCM_RIGHTS) {
+            closeFds(receivedFds, receivedFdCount);
+            receivedFdCount = std::min<size_t>((controlMessage->cmsg_len - CMSG_LEN(0)) / sizeof(int), maxReceivedFds);
+            memcpy(receivedFds, CMSG_DATA(controlMessage), sizeof(int) * receivedFdCount);
+        }
+
+        if (!m_receiveStream.received(len, handled, dispatch)) {
+            fprintf(stderr, "IPC::Client: malformed message stream\n");
+            break;
+        }
+
+        if (static_cast<size_t>(len) < readSize || (readLimit == Message::size && handled))
+            break;
+    }
+
+    // The host does not pass descriptors for anything else. They are kept
+    // until here in case the setup message was split across reads.
+    closeFds(receivedFds, receivedFdCount);
+
+    m_lanes.flush(handle);
+    m_receiveStatistics.record(handled);
+
+    // The host may already have filled the ring before it was adopted.
+    if (ringAdopted)
+        receiveFromRing();
+}
+
+void Client::receiveFromRing()
+{
+    Ring* ring = m_ring;
+    if (!ring)
+        return;
+
+    ring->clearDoorbell(Ring::Side::Client);
+
+    auto handle = [this](char* data, size_t size) {
+        dispatchMessage(data, size);
+    };
+
+    size_t handled = 0;
+    gint64 receiveTime = receiveTimestamp();
+    Message message;
+    while (m_handler && ring->pop(Ring::Side::Client, message)) {
+        m_lanes.dispatch(Message::data(message), Message::size, receiveTime, handle);
+        ++handled;
+    }
+    m_lanes.flush(handle);
+
+    m_receiveStatistics.record(handled);
+}
+
+void Client::sendFds(const int* fds, size_t fdCount, Message& message)
 {
-    GSocketControlMessage* fdMessage = g_unix_fd_message_new();
-    if (!g_unix_fd_message_append_fd(G_UNIX_FD_MESSAGE(fdMessage), fd, nullptr)) {
-        g_object_unref(fdMessage);
+    if (fdCount > Message::maxFds) {
+        fprintf(stderr, "IPC::Client: cannot send %zu descriptors at once\n", fdCount);
         return;
     }
 
-    if (g_socket_send_message(m_socket, nullptr, nullptr, 0, &fdMessage, 1, 0, nullptr, nullptr) == -1) {
-        g_object_unref(fdMessage);
+    if (m_recorder)
+        m_recorder->record(Trace::Sent, message, nullptr, 0);
+
+    m_sendCork.flush();
+    message.messageCode |= Message::fdsFlag;
+    bool sent = sendMessageWithFds(m_socket, message, fds, fdCount);
+    message.messageCode &= ~Message::fdsFlag;
+
+    if (!sent) {
+        fprintf(stderr, "IPC::Client: failed to send %zu descriptors (%s)\n", fdCount, strerror(errno));
         return;
     }
+    ++m_sentMessages;
+}
 
-    g_object_unref(fdMessage);
+void Client::sendFd(int fd)
+{
+    Message message;
+    message.messageCode = fdTransferCode;
+    sendFds(&fd, 1, message);
 }
 
 void Client::sendMessage(char* data, size_t size)
 {
-    g_socket_send(m_socket, data, size, nullptr, nullptr);
+    if (!m_flowPolicy || size != Message::size) {
+        transmit(data, size);
+        return;
+    }
+
+    if (!m_pendingSize && m_sentMessages - m_acknowledgedMessages < m_flowHighWater) {
+        transmit(data, size);
+        return;
+    }
+
+    // The host is behind. Rather than blocking on a full socket, let the
+    // policy decide what to do with the message.
+    if (!m_pendingSize)
+        ++m_flowStatistics.backpressureEvents;
+
+    auto& message = Message::cast(data);
+    FlowAction action = m_flowPolicy(message);
+    if (action == FlowAction::Drop) {
+        ++m_flowStatistics.dropped;
+        return;
+    }
+
+    if (action == FlowAction::Coalesce && m_pendingSize) {
+        auto& last = m_pendingMessages[(m_pendingHead + m_pendingSize - 1) % maxPendingMessages];
+        if (last.messageCode == message.messageCode && m_flowPolicy(last) == FlowAction::Coalesce) {
+            last = message;
+            ++m_flowStatistics.coalesced;
+            return;
+        }
+    }
+
+    // Nothing queued is ever lost; when the queue is full, the oldest
+    // message goes out even if that means blocking.
+    if (m_pendingSize == maxPendingMessages) {
+        transmit(Message::data(m_pendingMessages[m_pendingHead]), Message::size);
+        m_pendingHead = (m_pendingHead + 1) % maxPendingMessages;
+        --m_pendingSize;
+    }
+
+    m_pendingMessages[(m_pendingHead + m_pendingSize) % maxPendingMessages] = message;
+    ++m_pendingSize;
+    ++m_flowStatistics.queued;
+    m_flowStatistics.maxPending = std::max(m_flowStatistics.maxPending, m_pendingSize);
+}
+
+void Client::sendMessage(Message& message, const void* payload, size_t payloadSize)
+{
+    if (m_recorder)
+        m_recorder->record(Trace::Sent, message, payload, payloadSize);
+
+    m_sendCork.flush();
+    if (!sendMessageWithPayload(m_socket, message, payload, payloadSize)) {
+        fprintf(stderr, "IPC::Client: failed to send a message with a %zu byte payload\n", payloadSize);
+        return;
+    }
+    ++m_sentMessages;
+}
+
+void Client::transmit(char* data, size_t size)
+{
+    ++m_sentMessages;
+    if (m_recorder && size >= Message::size)
+        m_recorder->record(Trace::Sent, data, size);
+
+    Ring* ring = m_sendRing;
+    if (ring && size == Message::size && ring->push(Ring::Side::Client, Message::cast(data)))
+        return;
+
+    if (size >= Message::size && m_sendCork.append(data, size, m_lanes.classify(Message::cast(data).messageCode)))
+        return;
+    m_sendCork.flush();
+    sendData(m_socket, data, size);
+}
+
+void Client::enableFlowControl(FlowPolicy policy)
+{
+    if (m_flowPolicy || !policy || flowControlDisabled())
+        return;
+
+    m_pendingMessages.resize(maxPendingMessages);
+    m_flowHighWater = flowHighWater();
+
+    Message message;
+    message.messageCode = flowControlCode;
+    transmit(Message::data(message), Message::size);
+
+    // The host starts counting with the messages that follow.
+    m_flowPolicy = policy;
+    m_sentMessages = m_acknowledgedMessages = 0;
+}
+
+void Client::handleCredit(const Message& message)
+{
+    uint64_t handledMessages;
+    memcpy(&handledMessages, message.messageData, sizeof(handledMessages));
+    m_acknowledgedMessages = std::max(m_acknowledgedMessages, handledMessages);
+
+    sendPendingMessages();
+}
+
+void Client::sendPendingMessages()
+{
+    while (m_pendingSize && m_sentMessages - m_acknowledgedMessages < m_flowHighWater) {
+        transmit(Message::data(m_pendingMessages[m_pendingHead]), Message::size);
+        m_pendingHead = (m_pendingHead + 1) % maxPendingMessages;
+        --m_pendingSize;
+    }
 }
 
 } // namespace IPC
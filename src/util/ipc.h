@@ -28,9 +28,12 @@
 #ifndef wpe_platform_ipc_h
 #define wpe_platform_ipc_h
 
-#include <gio/gio.h>
+#include <atomic>
+#include <cstring>
+#include <glib.h>
 #include <memory>
 #include <stdint.h>
+#include <vector>
 
 namespace IPC {
 
@@ -41,17 +44,204 @@ struct Message {
     uint64_t messageCode { 0 };
     uint8_t messageData[dataSize] { 0, };
 
+    // A message with payloadFlag set in its code is followed on the wire by a
+    // payload of arbitrary length, stored in the first four data bytes. The
+    // handler gets the message with the flag cleared and the payload right
+    // after it, i.e. at data + Message::size, in a single call.
+    static const uint64_t payloadFlag = 0x0000800000000000ull;
+    static const size_t maxPayloadSize = 1 << 20;
+
+    // Set on the wire for a message that carries descriptors, see
+    // Client::sendFds().
+    static const uint64_t fdsFlag = 0x0000400000000000ull;
+    static const size_t maxFds = 8;
+
     static char* data(Message& message) { return reinterpret_cast<char*>(std::addressof(message)); }
     static Message& cast(char* data) { return *reinterpret_cast<Message*>(data); }
+
+    static char* payload(char* data) { return data + size; }
+    static uint32_t payloadSize(const Message& message)
+    {
+        uint32_t payloadSize;
+        memcpy(&payloadSize, message.messageData, sizeof(payloadSize));
+        return payloadSize;
+    }
 };
 static_assert(sizeof(Message) == Message::size, "Message is of correct size");
 
+// Message codes with all of these bits set are used by the IPC layer itself
+// and never reach the handlers.
+static const uint64_t reservedCode = 0xFFFF000000000000ull;
+static const uint64_t ringSetupCode = reservedCode | 0x01;
+static const uint64_t flowControlCode = reservedCode | 0x02;
+static const uint64_t creditCode = reservedCode | 0x03;
+static const uint64_t fdTransferCode = reservedCode | 0x04;
+static const uint64_t signalSetupCode = reservedCode | 0x05;
+
+class Ring;
+class ReceiveThread;
+class Recorder;
+class Replayer;
+
+// Upper bound of messages read from the socket with a single receive call.
+// WPE_IPC_RECEIVE_BATCH can lower it; a value of 1 restores the former
+// behavior of handling exactly one message per main loop wakeup.
+static const size_t maxReceiveBatch = 32;
+static const size_t receiveBufferSize = maxReceiveBatch * Message::size;
+
+// Reassembles the socket byte stream into messages, so a read may end at any
+// byte. Fixed-size messages, and payloads that fit, are dispatched straight
+// from the inline buffer; only larger payloads get a heap buffer of their own.
+class MessageStream {
+public:
+    char* writePosition();
+    size_t writableSize(size_t limit) const;
+
+    // Accounts for length bytes written at writePosition() and passes every
+    // complete message to the handler. Returns false on a malformed stream.
+    template<typename Handler> bool received(size_t length, size_t& handled, const Handler&);
+
+private:
+    alignas(Message) char m_buffer[receiveBufferSize];
+    size_t m_buffered { 0 };
+    std::vector<char> m_largeMessage;
+};
+
+// Received messages fall into two classes. Control messages, e.g. buffer
+// commits and frame completions, are handled as soon as they are read. Input
+// messages read in the same wakeup are queued and handled after them, in
+// their original order, so a frame acknowledgement never waits behind a
+// backlog of pointer motion. Every code is control unless registered. The
+// class of outgoing messages decides whether they may be corked, see SendCork.
+enum class MessageClass { Control, Input };
+
+class MessageLanes {
+public:
+    static const size_t classCount = 2;
+
+    void setClass(uint64_t messageCode, MessageClass);
+    MessageClass classify(uint64_t messageCode) const;
+
+    // Handles control messages right away and queues input ones. The receive
+    // time is only used for statistics and may be 0.
+    template<typename Handler> void dispatch(char*, size_t, gint64 receiveTime, const Handler&);
+    // Handles the queued input messages; called at the end of every wakeup.
+    template<typename Handler> void flush(const Handler&);
+
+    struct Statistics {
+        uint64_t messages { 0 };
+        uint64_t totalWait { 0 };
+        uint64_t maxWait { 0 };
+        size_t maxDepth { 0 };
+    };
+    const Statistics& statistics(MessageClass messageClass) const { return m_statistics[static_cast<size_t>(messageClass)]; }
+    void print(const char* name) const;
+
+private:
+    static const size_t maxInputCode = 256;
+    static const size_t inputQueueCapacity = 64;
+
+    void record(MessageClass, gint64 receiveTime);
+
+    uint64_t m_inputCodes[maxInputCode / 64] { 0, };
+
+    Message m_inputQueue[inputQueueCapacity];
+    gint64 m_inputQueueTimes[inputQueueCapacity];
+    size_t m_inputQueueHead { 0 };
+    size_t m_inputQueueSize { 0 };
+
+    Statistics m_statistics[classCount];
+};
+
+// Decides what happens to a message sent while the receiver is behind, see
+// Client::enableFlowControl(). Queued messages are sent, in order, as soon as
+// the receiver catches up. Coalesce replaces the last queued message if it has
+// the same code and is coalescable as well, e.g. for pointer motion, and
+// queues otherwise. Drop discards the message.
+enum class FlowAction { Queue, Coalesce, Drop };
+using FlowPolicy = FlowAction (*)(const Message&);
+
+struct FlowStatistics {
+    void print(const char* name) const;
+
+    // Number of times the high-water mark was reached.
+    uint64_t backpressureEvents { 0 };
+    uint64_t queued { 0 };
+    uint64_t coalesced { 0 };
+    uint64_t dropped { 0 };
+    size_t maxPending { 0 };
+};
+
+// With WPE_IPC_CORK set, input messages are not written one by one but
+// collected until the main loop is about to sleep again, so a burst sent from
+// one dispatch costs a single sendmsg(). Any other message flushes what is
+// collected, together with itself, right away. Not used with the ring, whose
+// doorbell is already rung once per burst.
+class SendCork {
+public:
+    static const size_t capacity = 64;
+
+    ~SendCork() { disable(); }
+
+    void enable(int fd);
+    void disable();
+    bool isEnabled() const { return m_source; }
+
+    // Takes the message unless corking is disabled, in which case the caller
+    // sends it itself.
+    bool append(const char*, size_t, MessageClass);
+    void flush();
+
+    struct Statistics {
+        void print(const char* name) const;
+
+        uint64_t messages { 0 };
+        uint64_t flushes { 0 };
+        size_t maxBatch { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+
+private:
+    struct Source;
+
+    int m_fd { -1 };
+    GSource* m_source { nullptr };
+
+    alignas(Message) char m_buffer[capacity * Message::size];
+    size_t m_size { 0 };
+
+    Statistics m_statistics;
+};
+
+struct ReceiveStatistics {
+    static const size_t histogramSize = 6;
+
+    void record(size_t messages);
+    void print(const char* name) const;
+
+    uint64_t wakeups { 0 };
+    uint64_t messages { 0 };
+    size_t maxMessagesPerWakeup { 0 };
+    // Wakeups bucketed by the number of handled messages: 0, 1, 2-3, 4-7, 8-15, 16+.
+    uint64_t histogram[histogramSize] { 0, };
+};
+
 class Host {
 public:
     class Handler {
     public:
         virtual void handleFd(int) = 0;
         virtual void handleMessage(char*, size_t) = 0;
+
+        // Receives the descriptors sent with Client::sendFds() along with the
+        // message describing them, and takes ownership of the descriptors.
+        // By default the first one goes to handleFd(), the others are closed
+        // and the message, unless sent by Client::sendFd(), to handleMessage().
+        virtual void handleFds(const int*, size_t, char*, size_t);
+
+        // Receives Client::sendSignal(). Signals sent before this is called
+        // are merged, the count says how many they were.
+        virtual void handleSignal(uint64_t) { }
     };
 
     Host();
@@ -62,15 +252,86 @@ public:
     int releaseClientFD();
 
     void sendMessage(char*, size_t);
+    void sendMessage(Message&, const void* payload, size_t payloadSize);
+
+    // Hands a pair of eventfds to the client along with the socket, one for
+    // each direction, for signals that carry no data, e.g. buffer commits
+    // and frame completions. A signal is a single eventfd write and never
+    // waits behind queued messages. Must be called before releaseClientFD();
+    // WPE_IPC_SIGNALS=0 turns it into a no-op.
+    void enableSignals();
+    // Returns false, and the caller sends a message instead, as long as the
+    // client has not taken the eventfds over.
+    bool sendSignal();
+
+    void setMessageClass(uint64_t messageCode, MessageClass messageClass) { m_lanes.setClass(messageCode, messageClass); }
+
+    const ReceiveStatistics& receiveStatistics() const { return m_receiveStatistics; }
+    const MessageLanes& lanes() const { return m_lanes; }
 
 private:
-    static gboolean socketCallback(GSocket*, GIOCondition, gpointer);
+    static gboolean socketCallback(gint, GIOCondition, gpointer);
+    static gboolean ringCallback(gint, GIOCondition, gpointer);
+    static gboolean signalCallback(gint, GIOCondition, gpointer);
+
+    bool setUpRing();
+    bool setUpSignals();
+    gboolean receiveFromSocket();
+    void receiveFromRing();
 
     Handler* m_handler;
 
-    GSocket* m_socket;
-    GSource* m_source;
+    int m_socket { -1 };
+    GSource* m_source { nullptr };
     int m_clientFd { -1 };
+
+    // Set when WPE_IPC_TRANSPORT=ring and the shared ring could be created.
+    Ring* m_ring { nullptr };
+    GSource* m_ringSource { nullptr };
+    // Set once the client confirms it sends through the ring as well.
+    bool m_clientOnRing { false };
+
+    bool m_signalsEnabled { false };
+    int m_incomingSignalFd { -1 };
+    int m_outgoingSignalFd { -1 };
+    GSource* m_signalSource { nullptr };
+    // Set once the client confirms it waits for signals.
+    bool m_clientOnSignals { false };
+
+    static void replayMessage(char*, size_t, void*);
+
+    bool handleReservedMessage(const Message&);
+    void deliverMessage(char*, size_t);
+    void handleMessageWithFds(char*, size_t);
+    void queueReceivedFds(const int*, size_t);
+    void closeReceivedFds();
+    void sendCredit();
+
+    // Set up from WPE_IPC_RECORD and WPE_IPC_REPLAY respectively.
+    Recorder* m_recorder { nullptr };
+    Replayer* m_replayer { nullptr };
+
+    // Descriptors read from the socket, one batch per flagged message, in
+    // the order those messages are still to be dispatched. A read carries at
+    // most one batch, so a few are enough for a message split across reads.
+    struct ReceivedFds {
+        int fds[Message::maxFds];
+        size_t count;
+    };
+    static const size_t maxReceivedFdBatches = 4;
+    ReceivedFds m_receivedFds[maxReceivedFdBatches];
+    size_t m_receivedFdHead { 0 };
+    size_t m_receivedFdBatches { 0 };
+
+    // Set once the client asks for credits, see Client::enableFlowControl().
+    bool m_flowControlEnabled { false };
+    uint64_t m_handledMessages { 0 };
+    uint64_t m_creditedMessages { 0 };
+
+    MessageStream m_receiveStream;
+    MessageLanes m_lanes;
+    ReceiveStatistics m_receiveStatistics;
+    SendCork m_sendCork;
 };
 
 class Client {
@@ -78,6 +339,9 @@ public:
     class Handler {
     public:
         virtual void handleMessage(char*, size_t) = 0;
+
+        // Receives Host::sendSignal(), see Host::Handler::handleSignal().
+        virtual void handleSignal(uint64_t) { }
     };
 
     Client();
@@ -87,16 +351,100 @@ public:
 
     void readSynchronously();
 
+    // Sends the descriptors together with a message describing them, e.g.
+    // the planes of a buffer, in a single transfer. Always uses the socket.
+    void sendFds(const int*, size_t, Message&);
+    // Same as sendFds() with a single descriptor and no message.
     void sendFd(int);
     void sendMessage(char*, size_t);
+    void sendMessage(Message&, const void* payload, size_t payloadSize);
+
+    // Returns false when the host did not hand over eventfds for signals,
+    // see Host::enableSignals(). Signals are always handled on the thread
+    // that called initialize() and are not waited for by readSynchronously().
+    bool sendSignal();
+
+    // Messages with the given code bypass the handler and go to this function
+    // as soon as they are read. With WPE_IPC_RECEIVE_THREAD set, that happens
+    // on the receive thread. Must be called before initialize().
+    using DirectHandler = void (*)(char*, size_t, void*);
+    void setDirectHandler(uint64_t messageCode, DirectHandler, void*);
+
+    void setMessageClass(uint64_t messageCode, MessageClass messageClass) { m_lanes.setClass(messageCode, messageClass); }
+
+    // Keeps at most WPE_IPC_FLOW_HIGH_WATER (default 128) messages in flight
+    // to the host, which acknowledges handled messages with credits. Messages
+    // sent beyond that are passed through the policy instead of blocking on
+    // a full socket. Messages with a payload are never held back. Does
+    // nothing when WPE_IPC_FLOW_CONTROL=0.
+    void enableFlowControl(FlowPolicy);
+
+    const ReceiveStatistics& receiveStatistics() const { return m_receiveStatistics; }
+    const MessageLanes& lanes() const { return m_lanes; }
+    const FlowStatistics& flowStatistics() const { return m_flowStatistics; }
 
 private:
-    static gboolean socketCallback(GSocket*, GIOCondition, gpointer);
+    static gboolean socketCallback(gint, GIOCondition, gpointer);
+    static gboolean ringCallback(gint, GIOCondition, gpointer);
+    static void dispatchQueuedMessage(char*, size_t, void*);
+    static gboolean signalCallback(gint, GIOCondition, gpointer);
+
+    void transmit(char*, size_t);
+    void handleCredit(const Message&);
+    void sendPendingMessages();
+
+    void adoptRing(const int*, size_t);
+    void adoptSignals(const int*, size_t);
+    void confirmSetup(uint64_t);
+    void sendSetupConfirmation(Message&);
+    void receiveFromSocket();
+    void receiveFromRing();
+    void dispatchMessage(char*, size_t);
 
     Handler* m_handler;
 
-    GSocket* m_socket;
-    GSource* m_source;
+    int m_socket { -1 };
+    GSource* m_source { nullptr };
+
+    // Adopted once the host announces a shared ring over the socket. That
+    // happens on the receive thread if there is one, hence the atomic.
+    std::atomic<Ring*> m_ring { nullptr };
+    GSource* m_ringSource { nullptr };
+    // The same ring, used for sending once the host was told about it. Only
+    // touched by the thread that sends.
+    Ring* m_sendRing { nullptr };
+
+    // Owns the socket and ring sources when WPE_IPC_RECEIVE_THREAD is set.
+    ReceiveThread* m_receiveThread { nullptr };
+    // The context of the thread that called initialize().
+    GMainContext* m_context { nullptr };
+
+    // Adopted, possibly on the receive thread, like the ring.
+    std::atomic<int> m_outgoingSignalFd { -1 };
+    int m_incomingSignalFd { -1 };
+    GSource* m_signalSource { nullptr };
+
+    // Set up from WPE_IPC_RECORD.
+    Recorder* m_recorder { nullptr };
+
+    uint64_t m_directMessageCode { 0 };
+    DirectHandler m_directHandler { nullptr };
+    void* m_directHandlerData { nullptr };
+
+    FlowPolicy m_flowPolicy { nullptr };
+    size_t m_flowHighWater { 0 };
+    uint64_t m_sentMessages { 0 };
+    uint64_t m_acknowledgedMessages { 0 };
+    // Messages held back by flow control, reserved up front.
+    std::vector<Message> m_pendingMessages;
+    size_t m_pendingHead { 0 };
+    size_t m_pendingSize { 0 };
+    FlowStatistics m_flowStatistics;
+
+    MessageStream m_receiveStream;
+    MessageLanes m_lanes;
+    ReceiveStatistics m_receiveStatistics;
+    SendCork m_sendCork;
 };
 
 } // namespace IPC
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "resolution-governor.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <wpe/wpe.h>
+
+namespace WPE {
+
+const unsigned ResolutionGovernor::stepCount;
+const unsigned ResolutionGovernor::steps[stepCount] = { 100, 75, 50 };
+const unsigned ResolutionGovernor::windowFrames;
+const unsigned ResolutionGovernor::settleFrames;
+const unsigned ResolutionGovernor::initialWindowsToStepUp;
+const unsigned ResolutionGovernor::maximumWindowsToStepUp;
+const uint64_t ResolutionGovernor::idleInterval;
+
+std::unique_ptr<ResolutionGovernor> ResolutionGovernor::create(struct wpe_view_backend* backend, const char* name, SizeFunction sizeFunction, void* sizeData)
+{
+    // Nanoseconds per frame, 0 to follow the display, negative when disabled.
+    static int64_t targetInterval = []() -> int64_t {
+        const char* env = std::getenv("WPE_RESOLUTION_GOVERNOR");
+        if (!env)
+            return -1;
+
+        int fps = std::atoi(env);
+        if (fps < 0 || fps > 240) {
+            fprintf(stderr, "WPE::ResolutionGovernor: WPE_RESOLUTION_GOVERNOR must be between 0 and 240\n");
+            fps = 0;
+        }
+        return fps ? 1000000000 / fps : 0;
+    }();
+
+    if (targetInterval < 0)
+        return nullptr;
+    return std::unique_ptr<ResolutionGovernor>(new ResolutionGovernor(backend, name, targetInterval, sizeFunction, sizeData));
+}
+
+ResolutionGovernor::ResolutionGovernor(struct wpe_view_backend* backend, const char* name, uint64_t targetInterval, SizeFunction sizeFunction, void* sizeData)
+    : m_backend(backend)
+    , m_name(name)
+    , m_targetInterval(targetInterval)
+    , m_sizeFunction(sizeFunction)
+    , m_sizeData(sizeData)
+{
+}
+
+ResolutionGovernor::~ResolutionGovernor()
+{
+    if (statisticsEnabled())
+        m_statistics.print(m_name);
+}
+
+void ResolutionGovernor::setSize(uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+    dispatchSize();
+}
+
+void ResolutionGovernor::setRefreshInterval(uint64_t refreshInterval)
+{
+    m_refreshInterval = refreshInterval;
+}
+
+void ResolutionGovernor::frameDisplayed(uint64_t timestamp)
+{
+    m_statistics.framesAt[m_step]++;
+
+    uint64_t lastFrame = std::exchange(m_lastFrame, timestamp);
+    if (!lastFrame || timestamp <= lastFrame)
+        return;
+    if (m_settleFrames) {
+        m_settleFrames--;
+        return;
+    }
+
+    uint64_t interval = timestamp - lastFrame;
+    if (interval >= idleInterval)
+        return;
+
+    // Late once a refresh was missed, with some slack for jitter.
+    uint64_t target = m_targetInterval ? m_targetInterval : m_refreshInterval;
+    if (!target)
+        target = 1000000000 / 60;
+    m_frames++;
+    if (interval > target + target / 2)
+        m_lateFrames++;
+
+    if (m_frames >= windowFrames)
+        evaluate();
+}
+
+void ResolutionGovernor::evaluate()
+{
+    bool slow = m_lateFrames * 5 > m_frames;
+    bool smooth = m_lateFrames * 50 <= m_frames;
+    bool steppedUp = std::exchange(m_steppedUp, false);
+    m_frames = 0;
+    m_lateFrames = 0;
+
+    if (slow) {
+        m_goodWindows = 0;
+        if (m_step + 1 == stepCount)
+            return;
+
+        // The larger size did not hold for a single window, it will take
+        // longer before trying it again.
+        if (steppedUp)
+            m_windowsToStepUp = std::min(m_windowsToStepUp * 2, maximumWindowsToStepUp);
+        step(m_step + 1);
+        return;
+    }
+
+    // The larger size held, the next step up is tried as early as the first.
+    if (steppedUp)
+        m_windowsToStepUp = initialWindowsToStepUp;
+
+    if (!smooth || !m_step) {
+        m_goodWindows = 0;
+        return;
+    }
+
+    if (++m_goodWindows < m_windowsToStepUp)
+        return;
+
+    m_goodWindows = 0;
+    m_steppedUp = true;
+    step(m_step - 1);
+}
+
+void ResolutionGovernor::step(unsigned newStep)
+{
+    if (newStep > m_step)
+        m_statistics.stepsDown++;
+    else
+        m_statistics.stepsUp++;
+
+    m_step = newStep;
+    m_lastFrame = 0;
+    m_settleFrames = settleFrames;
+    dispatchSize();
+
+    if (statisticsEnabled())
+        fprintf(stderr, "%s: rendering at %u%% of %ux%u\n", m_name, scale(), m_width, m_height);
+}
+
+void ResolutionGovernor::dispatchSize()
+{
+    if (!m_width || !m_height)
+        return;
+
+    uint32_t renderWidth = std::max<uint32_t>(1, m_width * scale() / 100);
+    uint32_t renderHeight = std::max<uint32_t>(1, m_height * scale() / 100);
+    wpe_view_backend_dispatch_set_size(m_backend, renderWidth, renderHeight);
+
+    if (m_sizeFunction)
+        m_sizeFunction(m_sizeData, m_width, m_height, renderWidth, renderHeight);
+}
+
+void ResolutionGovernor::Statistics::print(const char* name) const
+{
+    if (!stepsDown)
+        return;
+
+    fprintf(stderr, "%s: render size stepped down %llu times, up %llu times, frames at 100%%, 75%% and 50%%: %llu, %llu, %llu\n",
+        name, static_cast<unsigned long long>(stepsDown), static_cast<unsigned long long>(stepsUp),
+        static_cast<unsigned long long>(framesAt[0]), static_cast<unsigned long long>(framesAt[1]), static_cast<unsigned long long>(framesAt[2]));
+}
+
+} // namespace WPE
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_resolution_governor_h
+#define wpe_platform_resolution_governor_h
+
+#include <memory>
+#include <stdint.h>
+
+struct wpe_view_backend;
+
+namespace WPE {
+
+// Lowers the render size of a view when the device cannot sustain the
+// target frame rate, and raises it back once there is headroom again.
+// The view is given a fraction of its size through
+// wpe_view_backend_dispatch_set_size(), stepping through 100, 75 and 50
+// percent, and the backend has the compositor scale the smaller buffers
+// up to the full size, see SizeFunction. Only backends with such a scaling
+// path may use it.
+//
+// Frame intervals are judged per window of frames: more than a fifth of
+// them late steps down at once, while stepping up takes several windows in
+// a row with almost none late, more after each step up that did not hold,
+// and back to the initial count once a step up holds.
+// Gaps of a quarter of a second or more are idle time and do not count.
+//
+// Enabled with WPE_RESOLUTION_GOVERNOR, set to the target frame rate or to
+// 0 to follow the refresh rate of the display.
+class ResolutionGovernor {
+public:
+    // Tells the backend the full size the rendered size scales up to.
+    using SizeFunction = void (*)(void*, uint32_t width, uint32_t height, uint32_t renderWidth, uint32_t renderHeight);
+
+    static std::unique_ptr<ResolutionGovernor> create(struct wpe_view_backend*, const char* name, SizeFunction, void*);
+
+    ResolutionGovernor(struct wpe_view_backend*, const char* name, uint64_t targetInterval, SizeFunction, void*);
+    ~ResolutionGovernor();
+
+    // The full size of the view, dispatched at the current scale.
+    void setSize(uint32_t width, uint32_t height);
+
+    // Nanoseconds between refreshes of the display, used when no target
+    // frame rate was given. 0 when unknown.
+    void setRefreshInterval(uint64_t);
+
+    // A frame reached the screen, at a time in nanoseconds.
+    void frameDisplayed(uint64_t timestamp);
+
+    // Percentage of the full size the view renders at.
+    unsigned scale() const { return steps[m_step]; }
+
+    // Maps a point on the surface, which spans the full size, to the size
+    // WebKit renders at. Input has to go through this before it is dispatched.
+    void toRenderCoordinates(int& x, int& y) const
+    {
+        x = x * static_cast<int>(scale()) / 100;
+        y = y * static_cast<int>(scale()) / 100;
+    }
+
+    static const unsigned stepCount = 3;
+    static const unsigned steps[stepCount];
+    static const unsigned windowFrames = 60;
+    static const unsigned settleFrames = 10;
+    static const unsigned initialWindowsToStepUp = 3;
+    static const unsigned maximumWindowsToStepUp = 48;
+    static const uint64_t idleInterval = 250 * 1000 * 1000;
+
+    struct Statistics {
+        void print(const char* name) const;
+
+        uint64_t stepsDown { 0 };
+        uint64_t stepsUp { 0 };
+        // Frames displayed at each step.
+        uint64_t framesAt[stepCount] { 0, 0, 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+
+private:
+    void evaluate();
+    void step(unsigned);
+    void dispatchSize();
+
+    struct wpe_view_backend* m_backend;
+    const char* m_name;
+    uint64_t m_targetInterval;
+    uint64_t m_refreshInterval { 0 };
+    SizeFunction m_sizeFunction;
+    void* m_sizeData;
+
+    uint32_t m_width { 0 };
+    uint32_t m_height { 0 };
+    unsigned m_step { 0 };
+
+    uint64_t m_lastFrame { 0 };
+    unsigned m_frames { 0 };
+    unsigned m_lateFrames { 0 };
+    // Frames skipped after a step, while WebKit relays out and reallocates.
+    unsigned m_settleFrames { 0 };
+    // Good windows in a row, and how many of them it takes to step up.
+    unsigned m_goodWindows { 0 };
+    unsigned m_windowsToStepUp { initialWindowsToStepUp };
+    // Whether the window being judged is the first one after a step up.
+    bool m_steppedUp { false };
+
+    Statistics m_statistics;
+};
+
+} // namespace WPE
+
+#endif // wpe_platform_resolution_governor_h
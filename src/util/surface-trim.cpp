@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "surface-trim.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace WPE {
+
+const unsigned SurfaceTrim::bufferCount;
+
+// Microseconds to wait before trimming a hidden view, negative when disabled.
+int64_t SurfaceTrim::trimDelay()
+{
+    static int64_t delay = []() -> int64_t {
+        const char* env = std::getenv("WPE_HIDDEN_TRIM_DELAY");
+        if (!env)
+            return 1000 * 1000;
+
+        int milliseconds = std::atoi(env);
+        return milliseconds < 0 ? -1 : milliseconds * int64_t(1000);
+    }();
+    return delay;
+}
+
+SurfaceTrim::SurfaceTrim(const char* name, ResizeFunction resizeFunction, void* resizeData)
+    : m_name(name)
+    , m_resizeFunction(resizeFunction)
+    , m_resizeData(resizeData)
+{
+}
+
+SurfaceTrim::~SurfaceTrim()
+{
+    cancelTimer();
+
+    if (statisticsEnabled())
+        m_statistics.print(m_name);
+}
+
+bool SurfaceTrim::setSize(uint32_t width, uint32_t height)
+{
+    m_width = width;
+    m_height = height;
+    return !m_trimmed;
+}
+
+void SurfaceTrim::setVisible(bool visible)
+{
+    if (visible == m_visible)
+        return;
+
+    m_visible = visible;
+    cancelTimer();
+
+    if (visible) {
+        if (!m_trimmed)
+            return;
+
+        m_trimmed = false;
+        m_trimBytes = 0;
+        m_resumeStart = g_get_monotonic_time();
+        m_resizeFunction(m_resizeData, m_width, m_height);
+        return;
+    }
+
+    int64_t delay = trimDelay();
+    if (delay < 0)
+        return;
+    if (!delay) {
+        trim();
+        return;
+    }
+
+    m_timer = g_timeout_source_new(delay / 1000);
+    g_source_set_callback(m_timer, timeout, this, nullptr);
+    g_source_attach(m_timer, g_main_context_get_thread_default());
+}
+
+void SurfaceTrim::frameRendered()
+{
+    if (m_trimBytes) {
+        m_statistics.bytesFreed += m_trimBytes;
+        if (statisticsEnabled())
+            fprintf(stderr, "%s: trimmed %ux%u window, an estimated %.1fMB freed\n", m_name, m_width, m_height, m_trimBytes / 1048576.0);
+        m_trimBytes = 0;
+    }
+
+    if (!m_resumeStart)
+        return;
+
+    uint64_t resumeTime = g_get_monotonic_time() - m_resumeStart;
+    m_resumeStart = 0;
+
+    m_statistics.resumes++;
+    m_statistics.totalResumeTime += resumeTime;
+    m_statistics.maxResumeTime = std::max(m_statistics.maxResumeTime, resumeTime);
+    if (statisticsEnabled())
+        fprintf(stderr, "%s: resumed at %ux%u, first frame after %.2fms\n", m_name, m_width, m_height, resumeTime / 1e3);
+}
+
+void SurfaceTrim::trim()
+{
+    if (m_trimmed || m_width * m_height <= 1)
+        return;
+
+    // Freed by the next frame, if one is rendered before the view is shown.
+    m_trimmed = true;
+    m_resumeStart = 0;
+    m_trimBytes = (uint64_t(m_width) * m_height - 1) * 4 * bufferCount;
+    m_statistics.trims++;
+    m_resizeFunction(m_resizeData, 1, 1);
+}
+
+gboolean SurfaceTrim::timeout(gpointer data)
+{
+    auto& surfaceTrim = *static_cast<SurfaceTrim*>(data);
+    g_source_unref(surfaceTrim.m_timer);
+    surfaceTrim.m_timer = nullptr;
+
+    surfaceTrim.trim();
+    return G_SOURCE_REMOVE;
+}
+
+void SurfaceTrim::cancelTimer()
+{
+    if (!m_timer)
+        return;
+
+    g_source_destroy(m_timer);
+    g_source_unref(m_timer);
+    m_timer = nullptr;
+}
+
+void SurfaceTrim::Statistics::print(const char* name) const
+{
+    if (!trims)
+        return;
+
+    fprintf(stderr, "%s: trimmed %llu times, an estimated %.1fMB freed in total, resumed %llu times, first frame after %.2fms on average, %.2fms at most\n",
+        name, static_cast<unsigned long long>(trims), bytesFreed / 1048576.0, static_cast<unsigned long long>(resumes),
+        resumes ? totalResumeTime / 1e3 / resumes : 0.0, maxResumeTime / 1e3);
+}
+
+} // namespace WPE
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_surface_trim_h
+#define wpe_platform_surface_trim_h
+
+#include <glib.h>
+#include <stdint.h>
+
+namespace WPE {
+
+// Gives back the buffers of a hidden view's native window by shrinking it
+// to a single pixel: the next frame swaps tiny buffers and the driver frees
+// the full size ones. That frame must not wait for the hidden frame rate,
+// backends let it complete at once while awaitsFrame(). Showing the view
+// resizes the window back right away, so that the first frame WebKit
+// renders for it allocates them again.
+//
+// Trimming waits WPE_HIDDEN_TRIM_DELAY milliseconds after the view was
+// hidden, 1000 by default, so that quickly switching back and forth between
+// applications costs nothing. A negative delay disables trimming.
+class SurfaceTrim {
+public:
+    using ResizeFunction = void (*)(void*, uint32_t width, uint32_t height);
+
+    SurfaceTrim(const char* name, ResizeFunction, void*);
+    ~SurfaceTrim();
+
+    // The size of the window while shown. Returns whether the caller should
+    // resize it now, it keeps the trimmed size until the view is shown.
+    bool setSize(uint32_t width, uint32_t height);
+
+    void setVisible(bool);
+    bool isTrimmed() const { return m_trimmed; }
+    // Trimmed, but no frame was rendered at the trimmed size yet.
+    bool awaitsFrame() const { return m_trimBytes; }
+
+    // Completes a trim or a resume, the first frame rendered at the new size.
+    void frameRendered();
+
+    // Buffers per window assumed when estimating the memory freed: the one
+    // on screen, the one being rendered and a queued one. The estimate only
+    // counts once a frame was rendered at the trimmed size.
+    static const unsigned bufferCount = 3;
+
+    struct Statistics {
+        void print(const char* name) const;
+
+        uint64_t trims { 0 };
+        uint64_t bytesFreed { 0 };
+        uint64_t resumes { 0 };
+        uint64_t totalResumeTime { 0 };
+        uint64_t maxResumeTime { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+
+private:
+    static int64_t trimDelay();
+    static gboolean timeout(gpointer);
+
+    void trim();
+    void cancelTimer();
+
+    const char* m_name;
+    ResizeFunction m_resizeFunction;
+    void* m_resizeData;
+
+    uint32_t m_width { 0 };
+    uint32_t m_height { 0 };
+    bool m_visible { true };
+    bool m_trimmed { false };
+    // Estimate of what the first frame of a trim frees.
+    uint64_t m_trimBytes { 0 };
+    // When the window was restored, 0 once a frame was rendered after it.
+    uint64_t m_resumeStart { 0 };
+    GSource* m_timer { nullptr };
+
+    Statistics m_statistics;
+};
+
+} // namespace WPE
+
+#endif // wpe_platform_surface_trim_h
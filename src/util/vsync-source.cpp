@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "vsync-source.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <glib-unix.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(HAVE_DRM)
+#include <xf86drm.h>
+#endif
+
+#if defined(HAVE_DISPMANX)
+#include <bcm_host.h>
+#endif
+
+namespace WPE {
+
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static struct timespec toTimespec(uint64_t time)
+{
+    struct timespec ts;
+    ts.tv_sec = time / 1000000000;
+    ts.tv_nsec = time % 1000000000;
+    return ts;
+}
+
+class TimerVSyncSource final : public VSyncSource {
+public:
+    static std::unique_ptr<VSyncSource> create(Callback callback, void* data, uint64_t interval)
+    {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (fd == -1) {
+            fprintf(stderr, "WPE::VSyncSource: failed to create a timerfd (%s)\n", strerror(errno));
+            return nullptr;
+        }
+
+        return std::unique_ptr<VSyncSource>(new TimerVSyncSource(callback, data, fd, interval));
+    }
+
+private:
+    TimerVSyncSource(Callback callback, void* data, int fd, uint64_t interval)
+        : VSyncSource(Type::Timer, callback, data)
+        , m_interval(interval)
+        , m_deadline(monotonicTime())
+    {
+        watch(fd);
+    }
+
+    // The first tick is the next one on the grid laid out by the previous
+    // ones. From there the kernel applies the interval to the absolute
+    // expiration time, so late wakeups do not shift the following ticks.
+    void arm() override
+    {
+        uint64_t now = monotonicTime();
+        uint64_t next = m_deadline + ((now - m_deadline) / m_interval + 1) * m_interval;
+
+        struct itimerspec spec;
+        spec.it_interval = toTimespec(m_interval);
+        spec.it_value = toTimespec(next);
+        if (timerfd_settime(fd(), TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+            fprintf(stderr, "WPE::VSyncSource: failed to arm the timerfd (%s)\n", strerror(errno));
+            return;
+        }
+        m_deadline = next - m_interval;
+    }
+
+    void disarm() override
+    {
+        struct itimerspec spec = { };
+        timerfd_settime(fd(), 0, &spec, nullptr);
+    }
+
+    void fdReady() override
+    {
+        uint64_t expirations;
+        if (read(fd(), &expirations, sizeof(expirations)) != sizeof(expirations) || !expirations)
+            return;
+
+        m_deadline += expirations * m_interval;
+        dispatch(m_deadline, expirations - 1);
+    }
+
+    uint64_t m_interval;
+    // Expiration time of the latest tick.
+    uint64_t m_deadline;
+};
+
+#if defined(HAVE_DRM)
+class DRMVSyncSource final : public VSyncSource {
+public:
+    static std::unique_ptr<VSyncSource> create(Callback callback, void* data)
+    {
+        const char* device = std::getenv("WPE_VSYNC_DRM_DEVICE");
+        if (!device)
+            device = "/dev/dri/card0";
+
+        int fd = open(device, O_RDWR | O_CLOEXEC);
+        if (fd == -1)
+            return nullptr;
+
+        // Check once that vblank events are available at all.
+        drmVBlank vblank;
+        memset(&vblank, 0, sizeof(vblank));
+        vblank.request.type = DRM_VBLANK_RELATIVE;
+        if (drmWaitVBlank(fd, &vblank)) {
+            fprintf(stderr, "WPE::VSyncSource: no vblank events from %s (%s)\n", device, strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+
+        return std::unique_ptr<VSyncSource>(new DRMVSyncSource(callback, data, fd));
+    }
+
+private:
+    DRMVSyncSource(Callback callback, void* data, int fd)
+        : VSyncSource(Type::DRM, callback, data)
+    {
+        watch(fd);
+    }
+
+    // Events are requested for the first CRTC, one refresh at a time. The
+    // one in flight when the source stops is dropped by dispatch().
+    void arm() override
+    {
+        if (!m_requested && !requestVBlank())
+            fprintf(stderr, "WPE::VSyncSource: failed to request a vblank event (%s)\n", strerror(errno));
+    }
+
+    void disarm() override { }
+
+    bool requestVBlank()
+    {
+        drmVBlank vblank;
+        memset(&vblank, 0, sizeof(vblank));
+        vblank.request.type = static_cast<drmVBlankSeqType>(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT);
+        vblank.request.sequence = 1;
+        vblank.request.signal = reinterpret_cast<unsigned long>(this);
+        m_requested = !drmWaitVBlank(fd(), &vblank);
+        return m_requested;
+    }
+
+    void fdReady() override
+    {
+        drmEventContext context;
+        memset(&context, 0, sizeof(context));
+        context.version = 2;
+        context.vblank_handler = vblankHandler;
+        drmHandleEvent(fd(), &context);
+    }
+
+    static void vblankHandler(int, unsigned sequence, unsigned seconds, unsigned microseconds, void* data)
+    {
+        auto& source = *static_cast<DRMVSyncSource*>(data);
+        source.m_requested = false;
+
+        // Queue the next event first, so that a slow callback does not make
+        // the request land after the following vblank.
+        if (source.isActive() && !source.requestVBlank())
+            fprintf(stderr, "WPE::VSyncSource: failed to request a vblank event (%s)\n", strerror(errno));
+
+        // Gaps after a stop are not missed vsyncs.
+        uint64_t missed = 0;
+        if (source.m_sequence && source.m_continuous && sequence > source.m_sequence + 1)
+            missed = sequence - source.m_sequence - 1;
+        source.m_sequence = sequence;
+        source.m_continuous = source.m_requested;
+
+        source.dispatch(static_cast<uint64_t>(seconds) * 1000000000 + static_cast<uint64_t>(microseconds) * 1000, missed);
+    }
+
+    bool m_requested { false };
+    // Whether the latest event was followed by a request right away.
+    bool m_continuous { false };
+    unsigned m_sequence { 0 };
+};
+#endif
+
+#if defined(HAVE_DISPMANX)
+// The VideoCore calls back on a thread of its own; an eventfd hands the vsync
+// over to the main context.
+class DispmanxVSyncSource final : public VSyncSource {
+public:
+    static std::unique_ptr<VSyncSource> create(Callback callback, void* data)
+    {
+        DISPMANX_DISPLAY_HANDLE_T display = vc_dispmanx_display_open(0);
+        if (display == DISPMANX_NO_HANDLE)
+            return nullptr;
+
+        int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (fd == -1) {
+            fprintf(stderr, "WPE::VSyncSource: failed to create an eventfd (%s)\n", strerror(errno));
+            vc_dispmanx_display_close(display);
+            return nullptr;
+        }
+
+        return std::unique_ptr<VSyncSource>(new DispmanxVSyncSource(callback, data, display, fd));
+    }
+
+    ~DispmanxVSyncSource()
+    {
+        disarm();
+        vc_dispmanx_display_close(m_display);
+    }
+
+private:
+    DispmanxVSyncSource(Callback callback, void* data, DISPMANX_DISPLAY_HANDLE_T display, int fd)
+        : VSyncSource(Type::Dispmanx, callback, data)
+        , m_display(display)
+    {
+        watch(fd);
+    }
+
+    void arm() override { vc_dispmanx_vsync_callback(m_display, vsyncCallback, this); }
+    void disarm() override { vc_dispmanx_vsync_callback(m_display, nullptr, nullptr); }
+
+    static void vsyncCallback(DISPMANX_UPDATE_HANDLE_T, void* data)
+    {
+        auto& source = *static_cast<DispmanxVSyncSource*>(data);
+        uint64_t value = 1;
+        ssize_t ret = write(source.fd(), &value, sizeof(value));
+        (void)ret;
+    }
+
+    void fdReady() override
+    {
+        uint64_t count;
+        if (read(fd(), &count, sizeof(count)) != sizeof(count) || !count)
+            return;
+        dispatch(monotonicTime(), count - 1);
+    }
+
+    DISPMANX_DISPLAY_HANDLE_T m_display;
+};
+#endif
+
+static std::unique_ptr<VSyncSource> createOfType(VSyncSource::Type type, VSyncSource::Callback callback, void* data, uint64_t interval)
+{
+    switch (type) {
+    case VSyncSource::Type::Dispmanx:
+#if defined(HAVE_DISPMANX)
+        return DispmanxVSyncSource::create(callback, data);
+#else
+        return nullptr;
+#endif
+    case VSyncSource::Type::DRM:
+#if defined(HAVE_DRM)
+        return DRMVSyncSource::create(callback, data);
+#else
+        return nullptr;
+#endif
+    case VSyncSource::Type::Timer:
+        return TimerVSyncSource::create(callback, data, interval);
+    }
+    return nullptr;
+}
+
+std::unique_ptr<VSyncSource> VSyncSource::create(Callback callback, void* data, unsigned timerRate)
+{
+    uint64_t interval = 1000000000 / std::max(timerRate, 1u);
+    bool capped = false;
+    bool timerFallback = true;
+    if (const char* maximumFPS = std::getenv("WEBKIT_MAXIMUM_FPS")) {
+        int fps = std::atoi(maximumFPS);
+        if (fps >= 1 && fps <= 100) {
+            interval = 1000000000 / fps;
+            capped = true;
+        }
+        // As it always did, 0 leaves pacing to the hardware, if any.
+        if (!fps)
+            timerFallback = false;
+    }
+
+    if (const char* requested = std::getenv("WPE_VSYNC_SOURCE")) {
+        Type type;
+        if (!strcmp(requested, "dispmanx"))
+            type = Type::Dispmanx;
+        else if (!strcmp(requested, "drm"))
+            type = Type::DRM;
+        else
+            type = Type::Timer;
+
+        if (auto source = createOfType(type, callback, data, interval))
+            return source;
+        if (!timerFallback) {
+            fprintf(stderr, "WPE::VSyncSource: %s is not available\n", requested);
+            return nullptr;
+        }
+        fprintf(stderr, "WPE::VSyncSource: %s is not available, falling back to the timer\n", requested);
+        return TimerVSyncSource::create(callback, data, interval);
+    }
+
+    if (!capped) {
+        if (auto source = createOfType(Type::Dispmanx, callback, data, interval))
+            return source;
+        if (auto source = createOfType(Type::DRM, callback, data, interval))
+            return source;
+    }
+    if (!timerFallback)
+        return nullptr;
+    return TimerVSyncSource::create(callback, data, interval);
+}
+
+VSyncSource::VSyncSource(Type type, Callback callback, void* data)
+    : m_type(type)
+    , m_callback(callback)
+    , m_callbackData(data)
+{
+    m_statistics.creationTime = monotonicTime();
+}
+
+VSyncSource::~VSyncSource()
+{
+    if (statisticsEnabled())
+        m_statistics.print(name());
+
+    if (m_source) {
+        g_source_destroy(m_source);
+        g_source_unref(m_source);
+    }
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+const char* VSyncSource::name() const
+{
+    switch (m_type) {
+    case Type::Timer:
+        return "WPE::VSyncSource (timer)";
+    case Type::DRM:
+        return "WPE::VSyncSource (drm)";
+    case Type::Dispmanx:
+        return "WPE::VSyncSource (dispmanx)";
+    }
+    return "WPE::VSyncSource";
+}
+
+void VSyncSource::start()
+{
+    if (m_active)
+        return;
+
+    m_active = true;
+    ++m_statistics.starts;
+    arm();
+}
+
+void VSyncSource::watch(int fd)
+{
+    m_fd = fd;
+    m_source = g_unix_fd_source_new(m_fd, G_IO_IN);
+    g_source_set_callback(m_source, reinterpret_cast<GSourceFunc>(fdCallback), this, nullptr);
+    g_source_set_priority(m_source, G_PRIORITY_HIGH + 30);
+    g_source_set_can_recurse(m_source, TRUE);
+    g_source_attach(m_source, g_main_context_get_thread_default());
+}
+
+gboolean VSyncSource::fdCallback(gint, GIOCondition condition, gpointer data)
+{
+    auto& source = *static_cast<VSyncSource*>(data);
+    if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+        fprintf(stderr, "%s: the descriptor failed, no more vsyncs\n", source.name());
+        return G_SOURCE_REMOVE;
+    }
+
+    source.fdReady();
+    return G_SOURCE_CONTINUE;
+}
+
+void VSyncSource::dispatch(uint64_t timestamp, uint64_t missed)
+{
+    if (!m_active)
+        return;
+
+    ++m_statistics.vsyncs;
+    m_statistics.missed += missed;
+
+    if (m_callback(timestamp, m_callbackData))
+        return;
+
+    ++m_statistics.idle;
+    m_active = false;
+    disarm();
+}
+
+void VSyncSource::Statistics::print(const char* name) const
+{
+    if (!vsyncs)
+        return;
+
+    double seconds = static_cast<double>(monotonicTime() - creationTime) / 1000000000;
+    fprintf(stderr, "%s: %llu vsyncs, %llu missed, %llu starts, %llu idle wakeups (%.2f per second)\n", name,
+        static_cast<unsigned long long>(vsyncs), static_cast<unsigned long long>(missed),
+        static_cast<unsigned long long>(starts), static_cast<unsigned long long>(idle),
+        seconds > 0 ? idle / seconds : 0);
+}
+
+} // namespace WPE
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2015, 2016 Igalia S.L.
+ * Copyright (C) 2015, 2016 Metrological
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef wpe_platform_vsync_source_h
+#define wpe_platform_vsync_source_h
+
+#include <glib.h>
+#include <memory>
+#include <stdint.h>
+
+namespace WPE {
+
+// Calls back once per display refresh on the thread default main context of
+// the thread that created it, with the CLOCK_MONOTONIC time of the vblank in
+// nanoseconds. View backends release FrameComplete from there, so the
+// renderer is paced by the display instead of by how fast it can draw.
+//
+// create() picks, in this order, the first of these that works:
+//   - dispmanx, the VideoCore vsync callback, in builds with HAVE_DISPMANX;
+//   - DRM vblank events from /dev/dri/card0, or WPE_VSYNC_DRM_DEVICE, in
+//     builds with HAVE_DRM;
+//   - a timerfd ticking on absolute deadlines, so it does not drift, at
+//     timerRate frames per second.
+// WPE_VSYNC_SOURCE=dispmanx|drm|timer forces one of them. Setting
+// WEBKIT_MAXIMUM_FPS, as before, caps the rate through the timer, and 0
+// still means no timer: create() then returns a hardware source or nothing,
+// and the backend completes frames without waiting for a vsync.
+//
+// A source only runs while there is work for it. It starts out stopped,
+// start() arms it, typically on a buffer commit, and it stops by itself at
+// the first vsync that the callback reports as unused. A view with nothing
+// to draw therefore does not wake up once per refresh, and during an
+// animation the source is not rearmed for every frame.
+class VSyncSource {
+public:
+    // Returns whether the vsync was put to use, e.g. released a frame.
+    using Callback = bool (*)(uint64_t, void*);
+
+    enum class Type { Timer, DRM, Dispmanx };
+
+    static std::unique_ptr<VSyncSource> create(Callback, void*, unsigned timerRate = 60);
+    virtual ~VSyncSource();
+
+    Type type() const { return m_type; }
+    const char* name() const;
+
+    // Resumes on the next refresh. The timer keeps its phase across stops,
+    // so frames land on the same cadence as before.
+    void start();
+    bool isActive() const { return m_active; }
+
+    struct Statistics {
+        void print(const char* name) const;
+
+        uint64_t vsyncs { 0 };
+        // Vsyncs the callback had no use for, i.e. wakeups for nothing.
+        uint64_t idle { 0 };
+        // Refreshes that went by without a callback while active, because
+        // the main loop was busy for longer than a frame.
+        uint64_t missed { 0 };
+        uint64_t starts { 0 };
+        uint64_t creationTime { 0 };
+    };
+    const Statistics& statistics() const { return m_statistics; }
+
+protected:
+    VSyncSource(Type, Callback, void*);
+
+    // Takes the descriptor over and watches it on the thread default main
+    // context, calling fdReady() whenever it becomes readable.
+    void watch(int fd);
+    int fd() const { return m_fd; }
+    virtual void fdReady() = 0;
+
+    virtual void arm() = 0;
+    virtual void disarm() = 0;
+
+    void dispatch(uint64_t timestamp, uint64_t missed = 0);
+
+private:
+    static gboolean fdCallback(gint, GIOCondition, gpointer);
+
+    Type m_type;
+    Callback m_callback;
+    void* m_callbackData;
+
+    int m_fd { -1 };
+    GSource* m_source { nullptr };
+
+    bool m_active { false };
+
+    Statistics m_statistics;
+};
+
+} // namespace WPE
+
+#endif // wpe_platform_vsync_source_h
@@ -29,7 +29,6 @@
 #ifndef wpe_platform_ipc_viv_imx6_h
 #define wpe_platform_ipc_viv_imx6_h
 
-#include <memory>
 #include <stdint.h>
 
 namespace IPC {
@@ -37,40 +36,17 @@ namespace IPC {
 namespace VIVimx6 {
 
 struct BufferCommit {
-    uint32_t width;
-    uint32_t height;
-    uint8_t padding[24];
-
     static const uint64_t code = 1;
-    static void construct(Message& message, uint32_t width, uint32_t height)
-    {
-        message.messageCode = code;
 
-        auto& messageData = *reinterpret_cast<BufferCommit*>(std::addressof(message.messageData));
-        messageData.width = width;
-        messageData.height = height;
-    }
-    static BufferCommit& cast(Message& message)
-    {
-        return *reinterpret_cast<BufferCommit*>(std::addressof(message.messageData));
-    }
+    uint32_t width;
+    uint32_t height;
+    // Counts frames from 1, see WPE::FramePipeline.
+    uint32_t sequence;
 };
-static_assert(sizeof(BufferCommit) == Message::dataSize, "BufferCommit is of correct size");
 
 struct FrameComplete {
-    int8_t padding[Message::dataSize];
-
     static const uint64_t code = 2;
-    static void construct(Message& message)
-    {
-        message.messageCode = code;
-    }
-    static FrameComplete& cast(Message& message)
-    {
-        return *reinterpret_cast<FrameComplete*>(std::addressof(message.messageData));
-    }
 };
-static_assert(sizeof(FrameComplete) == Message::dataSize, "FrameComplete is of correct size");
 
 } // namespace VIVimx6
 
@@ -28,10 +28,12 @@
 
 #include <wpe/wpe-egl.h>
 
+#include "frame-timeline.h"
 #include "ipc.h"
 #include <EGL/egl.h>
 #include <EGL/eglvivante.h>
 #include "ipc-viv-imx6.h"
+#include "ipc-message.h"
 
 namespace VIVimx6 {
 
@@ -41,17 +43,26 @@ struct EGLTarget : public IPC::Client::Handler {
 
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
+    void handleSignal(uint64_t) override;
+
+    // IPC messages
+    void handle(const IPC::VIVimx6::FrameComplete&);
 
     struct wpe_renderer_backend_egl_target* target;
     IPC::Client ipcClient;
 
     uint32_t width { 0 };
     uint32_t height { 0 };
+    uint32_t frameSequence { 0 };
 
     EGLNativeDisplayType eglNativeDisplay;
     EGLNativeWindowType eglNativeWindow;
+
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("VIVimx6::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::VIVimx6::FrameComplete>;
+
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target, int hostFd)
     : target(target)
 {
@@ -68,16 +79,21 @@ void EGLTarget::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::VIVimx6::FrameComplete::code:
-    {
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-        break;
-    }
-    default:
+    if (!EGLTargetMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "EGLTarget: unhandled message\n");
-    };
+}
+
+// FrameComplete, once the host signals it through an eventfd.
+void EGLTarget::handleSignal(uint64_t)
+{
+    handle(IPC::VIVimx6::FrameComplete { });
+}
+
+void EGLTarget::handle(const IPC::VIVimx6::FrameComplete&)
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 } // namespace VIVimx6
@@ -137,14 +153,19 @@ struct wpe_renderer_backend_egl_target_interface viv_imx6_renderer_backend_egl_t
     // frame_will_render
     [](void* data)
     {
+        auto& target = *static_cast<VIVimx6::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::WillRender);
     },
     // frame_rendered
     [](void* data)
     {
         auto& target = *static_cast<VIVimx6::EGLTarget*>(data);
+        if (target.timeline)
+            target.timeline->record(WPE::FrameTimeline::Rendered);
 
         IPC::Message message;
-        IPC::VIVimx6::BufferCommit::construct(message, target.width, target.height);
+        IPC::encode(message, IPC::VIVimx6::BufferCommit { target.width, target.height, ++target.frameSequence });
         target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
     },
 };
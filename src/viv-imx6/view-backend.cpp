@@ -29,9 +29,14 @@
 #include <wpe/wpe.h>
 
 #include "Libinput/LibinputServer.h"
+#include "frame-pipeline.h"
+#include "frame-throttle.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include <cstdio>
 #include "ipc-viv-imx6.h"
+#include "ipc-message.h"
+#include "vsync-source.h"
 
 namespace VIVimx6 {
 
@@ -48,7 +53,12 @@ struct ViewBackend : public IPC::Host::Handler, public WPE::LibinputServer::Clie
     void handleFd(int) override;
     void handleMessage(char*, size_t) override;
 
-    void commitBuffer(uint32_t, uint32_t);
+    void commitBuffer(uint32_t, uint32_t, uint32_t);
+    void releaseFrame();
+    static bool vsyncCallback(uint64_t, void*);
+
+    // IPC messages
+    void handle(const IPC::VIVimx6::BufferCommit& commit) { commitBuffer(commit.width, commit.height, commit.sequence); }
 
     // WPE::LibinputServer::Client
     void handleKeyboardEvent(struct wpe_input_keyboard_event*) override;
@@ -59,19 +69,31 @@ struct ViewBackend : public IPC::Host::Handler, public WPE::LibinputServer::Clie
     struct wpe_view_backend* backend;
     IPC::Host ipcHost;
 
+    // Committed frames, each vsync displays the oldest one.
+    std::unique_ptr<WPE::VSyncSource> vsyncSource;
+    WPE::FramePipeline pipeline { "VIVimx6::ViewBackend" };
+    // Holds FrameComplete back while the view is hidden.
+    WPE::FrameThrottle throttle { backend, "VIVimx6::ViewBackend", [](void* data) { static_cast<ViewBackend*>(data)->releaseFrame(); }, this };
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("VIVimx6::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
+
     uint32_t width { WIDTH };
     uint32_t height { HEIGHT };
 
 };
 
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend, IPC::VIVimx6::BufferCommit>;
+
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : backend(backend)
 {
     ipcHost.initialize(*this);
+    // Only FrameComplete is signalled, BufferCommit carries data.
+    ipcHost.enableSignals();
 }
 
 ViewBackend::~ViewBackend()
 {
+    vsyncSource = nullptr;
     ipcHost.deinitialize();
 
     WPE::LibinputServer::singleton().setClient(nullptr);
@@ -94,6 +116,8 @@ void ViewBackend::initialize()
 
     wpe_view_backend_dispatch_set_size(backend, width, height);
 
+    vsyncSource = WPE::VSyncSource::create(vsyncCallback, this);
+
     WPE::LibinputServer::singleton().setClient(this);
 }
 
@@ -106,29 +130,52 @@ void ViewBackend::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::VIVimx6::BufferCommit::code:
-    {
-        auto& bufferCommit = IPC::VIVimx6::BufferCommit::cast(message);
-        commitBuffer(bufferCommit.width, bufferCommit.height);
-        break;
-    }
-    default:
+    if (!ViewBackendMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "ViewBackend: unhandled message\n");
-    };
 }
 
-void ViewBackend::commitBuffer(uint32_t width, uint32_t height)
+void ViewBackend::commitBuffer(uint32_t width, uint32_t height, uint32_t sequence)
 {
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::BufferCommit);
+
     if (width != this->width || height != this->height)
         return;
 
-    IPC::Message message;
-    IPC::VIVimx6::FrameComplete::construct(message);
-    ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    if (pipeline.commit(sequence))
+        throttle.release();
+
+    if (vsyncSource)
+        vsyncSource->start();
+    else
+        vsyncCallback(0, this);
+}
+
+bool ViewBackend::vsyncCallback(uint64_t, void* data)
+{
+    auto& view = *static_cast<ViewBackend*>(data);
+    if (!view.pipeline.hasPending())
+        return false;
 
-    wpe_view_backend_dispatch_frame_displayed(backend);
+    if (view.pipeline.displayed())
+        view.throttle.release();
+
+    if (view.timeline)
+        view.timeline->record(WPE::FrameTimeline::FrameDisplayed);
+    wpe_view_backend_dispatch_frame_displayed(view.backend);
+    return true;
+}
+
+void ViewBackend::releaseFrame()
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+
+    if (!ipcHost.sendSignal()) {
+        IPC::Message message;
+        IPC::encode(message, IPC::VIVimx6::FrameComplete { });
+        ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    }
 }
 
 void ViewBackend::handleKeyboardEvent(struct wpe_input_keyboard_event* event)
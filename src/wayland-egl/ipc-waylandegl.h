@@ -29,7 +29,6 @@
 #ifndef wpe_platform_ipc_wayland_egl_h
 #define wpe_platform_ipc_wayland_egl_h
 
-#include <memory>
 #include <stdint.h>
 
 namespace IPC {
@@ -37,34 +36,63 @@ namespace IPC {
 namespace WaylandEGL {
 
 struct BufferCommit {
-    uint8_t padding[Message::dataSize];
-
     static const uint64_t code = 1;
-    static void construct(Message& message)
-    {
-        message.messageCode = code;
-    }
-    static BufferCommit& cast(Message& message)
-    {
-        return *reinterpret_cast<BufferCommit*>(std::addressof(message.messageData));
-    }
 };
-static_assert(sizeof(BufferCommit) == Message::dataSize, "BufferCommit is of correct size");
 
 struct FrameComplete {
-    int8_t padding[Message::dataSize];
-
     static const uint64_t code = 2;
-    static void construct(Message& message)
-    {
-        message.messageCode = code;
-    }
-    static FrameComplete& cast(Message& message)
-    {
-        return *reinterpret_cast<FrameComplete*>(std::addressof(message.messageData));
-    }
 };
-static_assert(sizeof(FrameComplete) == Message::dataSize, "FrameComplete is of correct size");
+
+// Sent instead of BufferCommit when the compositor supports wp_presentation,
+// once the committed buffer was presented or discarded. Times are in
+// nanoseconds of the presentation clock, presentationTime is 0 for a
+// discarded frame and refresh is 0 when the output has no fixed rate.
+struct FramePresented {
+    static const uint64_t code = 3;
+
+    uint64_t commitTime;
+    uint64_t presentationTime;
+    uint32_t refresh;
+    uint32_t flags;
+};
+
+// The commit matching a later FramePresented. Counts frames from 1, see
+// WPE::FramePipeline.
+struct FrameCommitted {
+    static const uint64_t code = 4;
+
+    uint32_t sequence;
+};
+
+// The compositor suspended the toplevel, or resumed it, see the suspended
+// state of xdg_toplevel. Frame completions are throttled while hidden.
+// Sent back to the renderer when the view, for either the compositor or the
+// embedder, was shown or hidden, so that it trims its window.
+struct Visibility {
+    static const uint64_t code = 5;
+
+    uint32_t visible;
+};
+
+// The compositor scales the surface of the renderer to a size of its
+// choosing, see wp_viewporter: the view may render at a lower resolution.
+struct Scaling {
+    static const uint64_t code = 6;
+};
+
+// The size the renderer's buffers are scaled to, whatever size they have.
+struct ViewportSize {
+    static const uint64_t code = 7;
+
+    uint32_t width;
+    uint32_t height;
+};
+
+// The renderer shrank its window while hidden. The next frame completes
+// whatever the hidden frame rate, so that it frees the full size buffers.
+struct Trimmed {
+    static const uint64_t code = 8;
+};
 
 } // namespace WaylandEGL
 
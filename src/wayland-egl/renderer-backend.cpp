@@ -31,10 +31,23 @@
 #include <wpe/wpe-egl.h>
 
 #include "display.h"
+#include "frame-timeline.h"
 #include "ipc.h"
 #include "ipc-waylandegl.h"
+#include "ipc-message.h"
+#include "presentation-time-client-protocol.h"
+#include "surface-trim.h"
+#include "viewporter-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
+
+// Added with xdg-shell version 6, newer than the bundled protocol header.
+#ifndef XDG_TOPLEVEL_STATE_SUSPENDED
+#define XDG_TOPLEVEL_STATE_SUSPENDED 9
+#endif
+#include <algorithm>
 #include <cstdio>
+#include <deque>
+#include <time.h>
 #include <wayland-client-protocol.h>
 
 namespace WaylandEGL {
@@ -62,7 +75,21 @@ struct EGLTarget : public IPC::Client::Handler {
     void initialize(Backend& backend, uint32_t width, uint32_t height);
     // IPC::Client::Handler
     void handleMessage(char* data, size_t size) override;
+    void handleSignal(uint64_t) override;
     void resize(uint32_t width, uint32_t height);
+    void resizeWindow(uint32_t width, uint32_t height);
+    void trimWindow(uint32_t width, uint32_t height);
+    void frameWillRender();
+    void frameRendered();
+    void framePresented(struct wp_presentation_feedback*, uint64_t presentationTime, uint32_t refresh, uint32_t flags);
+    void configure(struct wl_array* states);
+
+    static const struct wp_presentation_feedback_listener s_feedbackListener;
+
+    // IPC messages
+    void handle(const IPC::WaylandEGL::FrameComplete&);
+    void handle(const IPC::WaylandEGL::Visibility& message) { m_trim.setVisible(message.visible); }
+    void handle(const IPC::WaylandEGL::ViewportSize&);
 
     struct wpe_renderer_backend_egl_target* target;
     IPC::Client ipcClient;
@@ -72,9 +99,47 @@ struct EGLTarget : public IPC::Client::Handler {
     struct wl_egl_window* m_window { nullptr };
     struct xdg_surface *m_xdgSurface { nullptr };
     struct xdg_toplevel *m_xdgTopLevel { nullptr };
+    // Scales the buffers up when the view renders below its size.
+    struct wp_viewport* m_viewport { nullptr };
     Backend* m_backend { nullptr };
+
+    // Feedback for the commit of the frame being rendered. Once committed,
+    // frames wait in flight until they were presented or discarded, several
+    // of them with a deeper WPE::FramePipeline in the view backend.
+    struct FrameInFlight {
+        struct wp_presentation_feedback* feedback;
+        uint64_t commitTime;
+    };
+    struct wp_presentation_feedback* m_nextFeedback { nullptr };
+    std::deque<FrameInFlight> m_framesInFlight;
+    uint32_t m_frameSequence { 0 };
+    bool m_suspended { false };
+
+    std::unique_ptr<WPE::FrameTimeline> m_timeline { WPE::FrameTimeline::create("WaylandEGL::EGLTarget", WPE::FrameTimeline::Rendered) };
+
+    // Shrinks the window while the view is hidden.
+    WPE::SurfaceTrim m_trim { "WaylandEGL::EGLTarget", [](void* data, uint32_t width, uint32_t height) { static_cast<EGLTarget*>(data)->trimWindow(width, height); }, this };
+};
+
+const struct wp_presentation_feedback_listener EGLTarget::s_feedbackListener = {
+    // sync_output
+    [](void*, struct wp_presentation_feedback*, struct wl_output*) { },
+    // presented
+    [](void* data, struct wp_presentation_feedback* feedback, uint32_t secondsHigh, uint32_t secondsLow, uint32_t nanoseconds, uint32_t refresh, uint32_t, uint32_t, uint32_t flags)
+    {
+        uint64_t seconds = (static_cast<uint64_t>(secondsHigh) << 32) | secondsLow;
+        static_cast<EGLTarget*>(data)->framePresented(feedback, seconds * 1000000000 + nanoseconds, refresh, flags);
+    },
+    // discarded
+    [](void* data, struct wp_presentation_feedback* feedback)
+    {
+        static_cast<EGLTarget*>(data)->framePresented(feedback, 0, 0, 0);
+    },
 };
 
+using EGLTargetMessages = IPC::MessageRegistry<EGLTarget, IPC::WaylandEGL::FrameComplete, IPC::WaylandEGL::Visibility,
+    IPC::WaylandEGL::ViewportSize>;
+
 static void
 handle_ping(void *data, struct wl_shell_surface *shell_surface,
                                                        uint32_t serial)
@@ -134,11 +199,18 @@ void EGLTarget::initialize(Backend& backend, uint32_t width, uint32_t height)
         m_xdgTopLevel = xdg_surface_get_toplevel(m_xdgSurface);
         static const struct xdg_toplevel_listener topLevelListener = {
             // configure
-            [](void*, struct xdg_toplevel*, int32_t, int32_t, struct wl_array*) {},
+            [](void* data, struct xdg_toplevel*, int32_t, int32_t, struct wl_array* states)
+            {
+                static_cast<EGLTarget*>(data)->configure(states);
+            },
             // close
             [](void*, struct xdg_toplevel*) {},
+            // configure_bounds
+            [](void*, struct xdg_toplevel*, int32_t, int32_t) {},
+            // wm_capabilities
+            [](void*, struct xdg_toplevel*, struct wl_array*) {},
         };
-        xdg_toplevel_add_listener(m_xdgTopLevel, &topLevelListener, nullptr);
+        xdg_toplevel_add_listener(m_xdgTopLevel, &topLevelListener, this);
         xdg_toplevel_set_app_id(m_xdgTopLevel, "com.rdkcentral.WPEBackend");
         xdg_toplevel_set_title(m_xdgTopLevel, "WPE");
         xdg_toplevel_set_fullscreen(m_xdgTopLevel, nullptr);
@@ -162,21 +234,62 @@ void EGLTarget::initialize(Backend& backend, uint32_t width, uint32_t height)
     wl_region_destroy(region);
 
     m_window = wl_egl_window_create(m_surface, width, height);
+    m_trim.setSize(width, height);
+
+    if (auto* viewporter = m_backend->display.interfaces().viewporter) {
+        m_viewport = wp_viewporter_get_viewport(viewporter, m_surface);
+
+        IPC::Message message;
+        IPC::encode(message, IPC::WaylandEGL::Scaling { });
+        ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    }
 }
 
 void EGLTarget::resize(uint32_t width, uint32_t height)
 {
+    if (m_trim.setSize(width, height))
+        resizeWindow(width, height);
+}
+
+void EGLTarget::resizeWindow(uint32_t width, uint32_t height)
+{
+    if (!m_window)
+        return;
+
     wl_egl_window_resize(m_window, width, height, 0, 0);
     wl_display_flush(m_backend->display.display());
 }
 
+// Resizes for WPE::SurfaceTrim. A trim only frees the buffers once a frame
+// was rendered at the new size, the view backend does not hold that one.
+void EGLTarget::trimWindow(uint32_t width, uint32_t height)
+{
+    resizeWindow(width, height);
+    if (!m_trim.awaitsFrame())
+        return;
+
+    IPC::Message message;
+    IPC::encode(message, IPC::WaylandEGL::Trimmed { });
+    ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
+
 EGLTarget::~EGLTarget()
 {
     ipcClient.deinitialize();
 
+    if (m_nextFeedback)
+        wp_presentation_feedback_destroy(m_nextFeedback);
+    m_nextFeedback = nullptr;
+    for (auto& frame : m_framesInFlight)
+        wp_presentation_feedback_destroy(frame.feedback);
+    m_framesInFlight.clear();
+
     if (m_window)
         wl_egl_window_destroy(m_window);
     m_window = nullptr;
+    if (m_viewport)
+        wp_viewport_destroy(m_viewport);
+    m_viewport = nullptr;
     if (m_xdgTopLevel)
         xdg_toplevel_destroy(m_xdgTopLevel);
     m_xdgTopLevel = nullptr;
@@ -196,16 +309,111 @@ void EGLTarget::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case IPC::WaylandEGL::FrameComplete::code:
-    {
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
-        break;
-    }
-    default:
+    if (!EGLTargetMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "EGLTarget: unhandled message\n");
-    };
+}
+
+void EGLTarget::frameWillRender()
+{
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::WillRender);
+
+    // Requested ahead of eglSwapBuffers so that it applies to its commit.
+    auto* presentation = m_backend ? m_backend->display.interfaces().presentation : nullptr;
+    if (presentation && m_surface && !m_nextFeedback) {
+        m_nextFeedback = wp_presentation_feedback(presentation, m_surface);
+        wp_presentation_feedback_add_listener(m_nextFeedback, &s_feedbackListener, this);
+    }
+}
+
+void EGLTarget::frameRendered()
+{
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::Rendered);
+    m_trim.frameRendered();
+
+    wl_display *display = m_backend->display.display();
+    if(display)
+        wl_display_flush(display);
+
+    if (m_nextFeedback) {
+        struct timespec now;
+        clock_gettime(m_backend->display.presentationClock(), &now);
+        m_framesInFlight.push_back({ m_nextFeedback, now.tv_sec * 1000000000ull + now.tv_nsec });
+        m_nextFeedback = nullptr;
+
+        IPC::Message message;
+        IPC::encode(message, IPC::WaylandEGL::FrameCommitted { ++m_frameSequence });
+        ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+        return;
+    }
+
+    if (ipcClient.sendSignal())
+        return;
+
+    IPC::Message message;
+    IPC::encode(message, IPC::WaylandEGL::BufferCommit { });
+    ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
+
+void EGLTarget::framePresented(struct wp_presentation_feedback* feedback, uint64_t presentationTime, uint32_t refresh, uint32_t flags)
+{
+    wp_presentation_feedback_destroy(feedback);
+
+    // Requested for a frame that was never swapped, nobody waits for it.
+    if (feedback == m_nextFeedback) {
+        m_nextFeedback = nullptr;
+        return;
+    }
+
+    auto it = std::find_if(m_framesInFlight.begin(), m_framesInFlight.end(),
+        [feedback](const FrameInFlight& frame) { return frame.feedback == feedback; });
+    if (it == m_framesInFlight.end())
+        return;
+
+    uint64_t commitTime = it->commitTime;
+    m_framesInFlight.erase(it);
+
+    IPC::Message message;
+    IPC::encode(message, IPC::WaylandEGL::FramePresented { commitTime, presentationTime, refresh, flags });
+    ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
+
+void EGLTarget::configure(struct wl_array* states)
+{
+    auto* begin = static_cast<uint32_t*>(states->data);
+    auto* end = begin + states->size / sizeof(uint32_t);
+    bool suspended = std::find(begin, end, XDG_TOPLEVEL_STATE_SUSPENDED) != end;
+    if (suspended == m_suspended)
+        return;
+
+    m_suspended = suspended;
+    IPC::Message message;
+    IPC::encode(message, IPC::WaylandEGL::Visibility { !suspended });
+    ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
+
+// Applies with the next commit, the buffers of which may still have the
+// previous render size: either way they are scaled to the view's size.
+void EGLTarget::handle(const IPC::WaylandEGL::ViewportSize& message)
+{
+    if (!m_viewport || !message.width || !message.height)
+        return;
+
+    wp_viewport_set_destination(m_viewport, message.width, message.height);
+}
+
+// FrameComplete, once the host signals it through an eventfd.
+void EGLTarget::handleSignal(uint64_t)
+{
+    handle(IPC::WaylandEGL::FrameComplete { });
+}
+
+void EGLTarget::handle(const IPC::WaylandEGL::FrameComplete&)
+{
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::FrameComplete);
+    wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
 }
 
 } // namespace WaylandEGL
@@ -265,19 +473,12 @@ struct wpe_renderer_backend_egl_target_interface wayland_egl_renderer_backend_eg
     // frame_will_render
     [](void* data)
     {
+        static_cast<WaylandEGL::EGLTarget*>(data)->frameWillRender();
     },
     // frame_rendered
     [](void* data)
     {
-        auto& target = *static_cast<WaylandEGL::EGLTarget*>(data);
-
-        wl_display *display = target.m_backend->display.display();
-        if(display)
-            wl_display_flush(display);
-
-        IPC::Message message;
-        IPC::WaylandEGL::BufferCommit::construct(message);
-        target.ipcClient.sendMessage(IPC::Message::data(message), IPC::Message::size);
+        static_cast<WaylandEGL::EGLTarget*>(data)->frameRendered();
     },
 };
 
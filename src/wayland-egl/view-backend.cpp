@@ -30,6 +30,13 @@
 #include "display.h"
 #include "ipc.h"
 #include "ipc-waylandegl.h"
+#include "frame-pipeline.h"
+#include "frame-throttle.h"
+#include "frame-timeline.h"
+#include "ipc-message.h"
+#include "resolution-governor.h"
+#include "statistics.h"
+#include <algorithm>
 #include <cstdio>
 
 #define WIDTH 1280
@@ -46,23 +53,74 @@ struct ViewBackend : public IPC::Host::Handler {
     // IPC::Host::Handler
     void handleFd(int) override { };
     void handleMessage(char*, size_t) override;
+    void handleSignal(uint64_t) override { ackBufferCommit(); }
 
     void ackBufferCommit();
+    void releaseFrame();
+    void sendVisibility(bool);
+    void sendViewportSize(uint32_t width, uint32_t height);
     void initialize();
 
+    // IPC messages
+    void handle(const Wayland::EventDispatcher::AxisEvent&);
+    void handle(const Wayland::EventDispatcher::PointerEvent&);
+    void handle(const Wayland::EventDispatcher::TouchEvent&);
+    void handle(const Wayland::EventDispatcher::TouchSimpleEvent&);
+    void handle(const Wayland::EventDispatcher::KeyboardEvent&);
+    void handle(const IPC::WaylandEGL::BufferCommit&) { ackBufferCommit(); }
+    void handle(const IPC::WaylandEGL::FramePresented&);
+    void handle(const IPC::WaylandEGL::FrameCommitted&);
+    void handle(const IPC::WaylandEGL::Visibility& message) { throttle.setVisible(message.visible); }
+    void handle(const IPC::WaylandEGL::Trimmed&) { throttle.exemptFrame(); }
+    void handle(const IPC::WaylandEGL::Scaling&);
+
     struct wpe_view_backend* backend;
     IPC::Host ipcHost;
+    WPE::FramePipeline pipeline { "WaylandEGL::ViewBackend" };
+    // Holds FrameComplete back while the view is hidden.
+    WPE::FrameThrottle throttle { backend, "WaylandEGL::ViewBackend", [](void* data) { static_cast<ViewBackend*>(data)->releaseFrame(); }, this };
+    std::unique_ptr<WPE::FrameTimeline> timeline { WPE::FrameTimeline::create("WaylandEGL::ViewBackend", WPE::FrameTimeline::FrameDisplayed) };
+    // Lowers the render size when frames are late, once the renderer can
+    // have them scaled.
+    std::unique_ptr<WPE::ResolutionGovernor> governor;
+
+    uint32_t width { 0 };
+    uint32_t height { 0 };
+
+    struct PresentationStatistics {
+        void print() const;
+
+        uint64_t frames { 0 };
+        uint64_t discarded { 0 };
+        uint64_t totalLatency { 0 };
+        uint64_t maxLatency { 0 };
+        uint32_t refresh { 0 };
+    } presentationStatistics;
 };
 
+using ViewBackendMessages = IPC::MessageRegistry<ViewBackend,
+    Wayland::EventDispatcher::AxisEvent, Wayland::EventDispatcher::PointerEvent, Wayland::EventDispatcher::TouchEvent,
+    Wayland::EventDispatcher::TouchSimpleEvent, Wayland::EventDispatcher::KeyboardEvent, IPC::WaylandEGL::BufferCommit,
+    IPC::WaylandEGL::FramePresented, IPC::WaylandEGL::FrameCommitted, IPC::WaylandEGL::Visibility,
+    IPC::WaylandEGL::Scaling, IPC::WaylandEGL::Trimmed>;
+
 ViewBackend::ViewBackend(struct wpe_view_backend* backend)
     : backend(backend)
 {
     ipcHost.initialize(*this);
+    ipcHost.enableSignals();
+    for (uint64_t code = Wayland::EventDispatcher::MsgType::AXIS; code <= Wayland::EventDispatcher::MsgType::KEYBOARD; ++code)
+        ipcHost.setMessageClass(code, IPC::MessageClass::Input);
+
+    throttle.watchVisibility([](void* data, bool visible) { static_cast<ViewBackend*>(data)->sendVisibility(visible); }, this);
 }
 
 ViewBackend::~ViewBackend()
 {
     ipcHost.deinitialize();
+
+    if (WPE::statisticsEnabled())
+        presentationStatistics.print();
 }
 
 void ViewBackend::handleMessage(char* data, size_t size)
@@ -70,47 +128,106 @@ void ViewBackend::handleMessage(char* data, size_t size)
     if (size != IPC::Message::size)
         return;
 
-    auto& message = IPC::Message::cast(data);
-    switch (message.messageCode) {
-    case Wayland::EventDispatcher::MsgType::AXIS:
-    {
-        struct wpe_input_axis_event * event = reinterpret_cast<wpe_input_axis_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_axis_event(backend, event);
-        break;
-    }
-    case Wayland::EventDispatcher::MsgType::POINTER:
-    {
-        struct wpe_input_pointer_event * event = reinterpret_cast<wpe_input_pointer_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_pointer_event(backend, event);
-        break;
-    }
-    case Wayland::EventDispatcher::MsgType::TOUCH:
-    {
-        struct wpe_input_touch_event * event = reinterpret_cast<wpe_input_touch_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_touch_event(backend, event);
-        break;
-    }
-    case Wayland::EventDispatcher::MsgType::TOUCHSIMPLE:
-    {
-        struct wpe_input_touch_event_raw * touchpoint = reinterpret_cast<wpe_input_touch_event_raw*>(std::addressof(message.messageData));
-        struct wpe_input_touch_event event = { touchpoint, 1, touchpoint->type, touchpoint->id, touchpoint->time };
-        wpe_view_backend_dispatch_touch_event(backend, &event);
-        break;
-    }
-    case Wayland::EventDispatcher::MsgType::KEYBOARD:
-    {
-        struct wpe_input_keyboard_event * event = reinterpret_cast<wpe_input_keyboard_event*>(std::addressof(message.messageData));
-        wpe_view_backend_dispatch_keyboard_event(backend, event);
-        break;
-    }
-    case IPC::WaylandEGL::BufferCommit::code:
-    {
-        ackBufferCommit();
-        break;
-    }
-    default:
+    if (!ViewBackendMessages::dispatch(*this, IPC::Message::cast(data)))
         fprintf(stderr, "ViewBackend: unhandled message\n");
+}
+
+// Input comes in surface coordinates, which span the full size of the view
+// while the governor may have WebKit render at a fraction of it. Touch is
+// only forwarded as single touch points, see TouchSimpleEvent.
+void ViewBackend::handle(const Wayland::EventDispatcher::AxisEvent& message)
+{
+    struct wpe_input_axis_event event = message.data;
+    if (governor)
+        governor->toRenderCoordinates(event.x, event.y);
+    wpe_view_backend_dispatch_axis_event(backend, &event);
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::PointerEvent& message)
+{
+    struct wpe_input_pointer_event event = message.data;
+    if (governor)
+        governor->toRenderCoordinates(event.x, event.y);
+    wpe_view_backend_dispatch_pointer_event(backend, &event);
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::TouchEvent& message)
+{
+    struct wpe_input_touch_event event = message.data;
+    wpe_view_backend_dispatch_touch_event(backend, &event);
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::TouchSimpleEvent& message)
+{
+    struct wpe_input_touch_event_raw touchpoint = message.data;
+    if (governor)
+        governor->toRenderCoordinates(touchpoint.x, touchpoint.y);
+    struct wpe_input_touch_event event = { &touchpoint, 1, touchpoint.type, touchpoint.id, touchpoint.time };
+    wpe_view_backend_dispatch_touch_event(backend, &event);
+}
+
+void ViewBackend::handle(const Wayland::EventDispatcher::KeyboardEvent& message)
+{
+    struct wpe_input_keyboard_event event = message.data;
+    wpe_view_backend_dispatch_keyboard_event(backend, &event);
+}
+
+void ViewBackend::handle(const IPC::WaylandEGL::FrameCommitted& commit)
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::BufferCommit);
+
+    if (pipeline.commit(commit.sequence))
+        throttle.release();
+}
+
+// The frame reached the screen, or never will: either way the renderer
+// may produce the next one, paced by the compositor's refresh.
+void ViewBackend::handle(const IPC::WaylandEGL::FramePresented& message)
+{
+    auto& statistics = presentationStatistics;
+    if (message.presentationTime) {
+        uint64_t latency = message.presentationTime > message.commitTime ? message.presentationTime - message.commitTime : 0;
+        statistics.frames++;
+        statistics.totalLatency += latency;
+        statistics.maxLatency = std::max(statistics.maxLatency, latency);
+        statistics.refresh = message.refresh;
+    } else
+        statistics.discarded++;
+
+    if (pipeline.displayed())
+        throttle.release();
+
+    if (timeline) {
+        timeline->setRefreshInterval(message.refresh);
+        timeline->record(WPE::FrameTimeline::FrameDisplayed);
     }
+    if (governor && message.presentationTime) {
+        governor->setRefreshInterval(message.refresh);
+        governor->frameDisplayed(message.presentationTime);
+    }
+    wpe_view_backend_dispatch_frame_displayed(backend);
+}
+
+void ViewBackend::handle(const IPC::WaylandEGL::Scaling&)
+{
+    if (governor)
+        return;
+
+    governor = WPE::ResolutionGovernor::create(backend, "WaylandEGL::ViewBackend",
+        [](void* data, uint32_t width, uint32_t height, uint32_t, uint32_t) { static_cast<ViewBackend*>(data)->sendViewportSize(width, height); }, this);
+    if (governor)
+        governor->setSize(width, height);
+}
+
+void ViewBackend::PresentationStatistics::print() const
+{
+    if (!frames && !discarded)
+        return;
+
+    fprintf(stderr, "WaylandEGL::ViewBackend: %llu frames presented, %llu discarded, commit-to-present %.2fms on average, %.2fms at most, refresh %.2fms\n",
+        static_cast<unsigned long long>(frames), static_cast<unsigned long long>(discarded),
+        frames ? totalLatency / 1e6 / frames : 0.0, maxLatency / 1e6, refresh / 1e6);
 }
 
 void ViewBackend::initialize()
@@ -124,16 +241,56 @@ void ViewBackend::initialize()
     if (tmp = std::getenv("WPE_INIT_VIEW_HEIGHT"))
         h = atoi(tmp);
 
-    wpe_view_backend_dispatch_set_size( backend, w, h );
+    width = w;
+    height = h;
+    if (governor)
+        governor->setSize(w, h);
+    else
+        wpe_view_backend_dispatch_set_size( backend, w, h );
 }
 
+// Without presentation feedback a frame counts as displayed once committed.
+// Nothing tells when it actually was, so this path stays in lock-step and
+// bypasses the pipeline: WPE_FRAME_PIPELINE_DEPTH only applies to renderers
+// that send FrameCommitted and FramePresented.
 void ViewBackend::ackBufferCommit()
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::BufferCommit);
+
+    throttle.release();
+
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameDisplayed);
+    if (governor)
+        governor->frameDisplayed(g_get_monotonic_time() * 1000);
+    wpe_view_backend_dispatch_frame_displayed(backend);
+}
+
+void ViewBackend::releaseFrame()
+{
+    if (timeline)
+        timeline->record(WPE::FrameTimeline::FrameComplete);
+
+    if (!ipcHost.sendSignal()) {
+        IPC::Message message;
+        IPC::encode(message, IPC::WaylandEGL::FrameComplete { });
+        ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+    }
+}
+
+void ViewBackend::sendVisibility(bool visible)
 {
     IPC::Message message;
-    IPC::WaylandEGL::FrameComplete::construct(message);
+    IPC::encode(message, IPC::WaylandEGL::Visibility { visible });
     ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
+}
 
-    wpe_view_backend_dispatch_frame_displayed(backend);
+void ViewBackend::sendViewportSize(uint32_t width, uint32_t height)
+{
+    IPC::Message message;
+    IPC::encode(message, IPC::WaylandEGL::ViewportSize { width, height });
+    ipcHost.sendMessage(IPC::Message::data(message), IPC::Message::size);
 }
 
 } // namespace WaylandEGL
@@ -26,11 +26,15 @@
 
 #include "display.h"
 
+#include "ipc-flow-policy.h"
 #ifdef BACKEND_BCM_NEXUS_WAYLAND
 #include "nsc-client-protocol.h"
 #endif
+#include "presentation-time-client-protocol.h"
+#include "viewporter-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 #include "wayland-client-protocol.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <cstdio>
@@ -144,11 +148,18 @@ const struct wl_registry_listener g_registryListener = {
         if (!std::strcmp(interface, "wl_seat"))
             interfaces.seat = static_cast<struct wl_seat*>(wl_registry_bind(registry, name, &wl_seat_interface, 4));
 
+        // Version 6 adds the suspended toplevel state, without new events.
         if (!std::strcmp(interface, xdg_wm_base_interface.name))
-            interfaces.xdg = static_cast<struct xdg_wm_base*>(wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+            interfaces.xdg = static_cast<struct xdg_wm_base*>(wl_registry_bind(registry, name, &xdg_wm_base_interface, std::min(version, 6u)));
 
         if (!std::strcmp(interface, "wl_shell"))
             interfaces.shell = static_cast<struct wl_shell*>(wl_registry_bind(registry, name, &wl_shell_interface, 1));
+
+        if (!std::strcmp(interface, wp_presentation_interface.name))
+            interfaces.presentation = static_cast<struct wp_presentation*>(wl_registry_bind(registry, name, &wp_presentation_interface, 1));
+
+        if (!std::strcmp(interface, wp_viewporter_interface.name))
+            interfaces.viewporter = static_cast<struct wp_viewporter*>(wl_registry_bind(registry, name, &wp_viewporter_interface, 1));
     },
     // global_remove
     [](void*, struct wl_registry*, uint32_t) { },
@@ -580,6 +591,18 @@ Display::Display()
 
     if ( m_interfaces.seat )
         wl_seat_add_listener(m_interfaces.seat, &g_seatListener, &m_seatData);
+
+    // The clock is announced on bind and arrives ahead of any feedback.
+    if (m_interfaces.presentation) {
+        static const struct wp_presentation_listener presentationListener = {
+            // clock_id
+            [](void* data, struct wp_presentation*, uint32_t clockId)
+            {
+                static_cast<Display*>(data)->m_presentationClock = clockId;
+            },
+        };
+        wp_presentation_add_listener(m_interfaces.presentation, &presentationListener, this);
+    }
 }
 
 Display::~Display()
@@ -602,6 +625,10 @@ Display::~Display()
         xdg_wm_base_destroy(m_interfaces.xdg);
     if (m_interfaces.shell)
         wl_shell_destroy(m_interfaces.shell);
+    if (m_interfaces.presentation)
+        wp_presentation_destroy(m_interfaces.presentation);
+    if (m_interfaces.viewporter)
+        wp_viewporter_destroy(m_interfaces.viewporter);
     m_interfaces = {
         nullptr,
 #ifdef BACKEND_BCM_NEXUS_WAYLAND
@@ -610,6 +637,8 @@ Display::~Display()
         nullptr,
         nullptr,
         nullptr,
+        nullptr,
+        nullptr,
     };
 
     if (m_registry)
@@ -663,8 +692,7 @@ void EventDispatcher::sendEvent( wpe_input_axis_event& event )
     if ( m_ipc != nullptr )
     {
         IPC::Message message;
-        message.messageCode = MsgType::AXIS;
-        memcpy( message.messageData, &event, sizeof(event) );
+        IPC::encode( message, AxisEvent { event } );
         m_ipc->sendMessage(IPC::Message::data(message), IPC::Message::size);
     }
 }
@@ -674,8 +702,7 @@ void EventDispatcher::sendEvent( wpe_input_pointer_event& event )
     if ( m_ipc != nullptr )
     {
         IPC::Message message;
-        message.messageCode = MsgType::POINTER;
-        memcpy( message.messageData, &event, sizeof(event) );
+        IPC::encode( message, PointerEvent { event } );
         m_ipc->sendMessage(IPC::Message::data(message), IPC::Message::size);
     }
 }
@@ -685,8 +712,7 @@ void EventDispatcher::sendEvent( wpe_input_touch_event& event )
     if ( m_ipc != nullptr )
     {
         IPC::Message message;
-        message.messageCode = MsgType::TOUCH;
-        memcpy( message.messageData, &event, sizeof(event) );
+        IPC::encode( message, TouchEvent { event } );
         m_ipc->sendMessage(IPC::Message::data(message), IPC::Message::size);
     }
 }
@@ -696,8 +722,7 @@ void EventDispatcher::sendEvent( wpe_input_keyboard_event& event )
     if ( m_ipc != nullptr )
     {
         IPC::Message message;
-        message.messageCode = MsgType::KEYBOARD;
-        memcpy( message.messageData, &event, sizeof(event) );
+        IPC::encode( message, KeyboardEvent { event } );
         m_ipc->sendMessage(IPC::Message::data(message), IPC::Message::size);
     }
 }
@@ -707,8 +732,7 @@ void EventDispatcher::sendEvent( wpe_input_touch_event_raw& event )
     if ( m_ipc != nullptr )
     {
         IPC::Message message;
-        message.messageCode = MsgType::TOUCHSIMPLE;
-        memcpy( message.messageData, &event, sizeof(event) );
+        IPC::encode( message, TouchSimpleEvent { event } );
         m_ipc->sendMessage(IPC::Message::data(message), IPC::Message::size);
     }
 }
@@ -716,6 +740,10 @@ void EventDispatcher::sendEvent( wpe_input_touch_event_raw& event )
 void EventDispatcher::setIPC( IPC::Client& ipcClient )
 {
     m_ipc = &ipcClient;
+    m_ipc->enableFlowControl(IPC::coalescePointerMotion<MsgType::POINTER>);
+    // Input may be corked on the way out, see WPE_IPC_CORK.
+    for ( uint64_t code = MsgType::AXIS; code <= MsgType::KEYBOARD; ++code )
+        m_ipc->setMessageClass(code, IPC::MessageClass::Input);
 }
 
 } // namespace Wayland
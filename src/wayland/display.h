@@ -28,10 +28,12 @@
 #define wpe_view_backend_wayland_display_h
 
 #include <array>
+#include <time.h>
 #include <unordered_map>
 #include <utility>
 #include <wpe/wpe.h>
 #include "ipc.h"
+#include "ipc-message.h"
 
 struct wpe_view_backend;
 
@@ -48,6 +50,8 @@ struct wl_surface;
 struct wl_touch;
 struct xdg_wm_base;
 struct wl_shell;
+struct wp_presentation;
+struct wp_viewporter;
 
 typedef struct _GSource GSource;
 
@@ -71,6 +75,11 @@ public:
 	TOUCHSIMPLE,
 	KEYBOARD
     };
+    using AxisEvent = IPC::MessageOf<MsgType::AXIS, wpe_input_axis_event>;
+    using PointerEvent = IPC::MessageOf<MsgType::POINTER, wpe_input_pointer_event>;
+    using TouchEvent = IPC::MessageOf<MsgType::TOUCH, wpe_input_touch_event>;
+    using TouchSimpleEvent = IPC::MessageOf<MsgType::TOUCHSIMPLE, wpe_input_touch_event_raw>;
+    using KeyboardEvent = IPC::MessageOf<MsgType::KEYBOARD, wpe_input_keyboard_event>;
 private:
     EventDispatcher() {};
     ~EventDispatcher() {};
@@ -93,9 +102,15 @@ public:
         struct wl_seat* seat;
         struct xdg_wm_base* xdg;
         struct wl_shell* shell;
+        struct wp_presentation* presentation;
+        struct wp_viewporter* viewporter;
     };
     const Interfaces& interfaces() const { return m_interfaces; }
 
+    // Clock domain of the wp_presentation timestamps, as announced by the
+    // compositor. Only meaningful when interfaces().presentation is set.
+    uint32_t presentationClock() const { return m_presentationClock; }
+
     struct SeatData {
         std::unordered_map<struct wl_surface*, struct wpe_view_backend*> inputClients;
 
@@ -143,6 +158,7 @@ private:
     struct wl_display* m_display;
     struct wl_registry* m_registry;
     Interfaces m_interfaces;
+    uint32_t m_presentationClock { CLOCK_MONOTONIC };
 
     SeatData m_seatData;
 
@@ -36,6 +36,8 @@
 #include <wayland-client.h>
 #include <wayland-egl.h>
 
+#include "frame-timeline.h"
+
 #ifndef NDEBUG
 #define DEBUG_PRINT(...) fprintf(stderr, __VA_ARGS__)
 #else
@@ -48,11 +50,13 @@
 #include <unistd.h>
 
 #define DEFAULT_CARD "/dev/dri/card0"
-#define DEFAULT_MODE_WIDTH (1280)
-#define DEFAULT_MODE_HEIGHT (720)
 
 namespace GBM{
 
+// Offscreen targets only give WebKit a surface to make its contexts current
+// on, nothing renders to them nor shows them. A single pixel surface, not
+// usable for scanout, spares the display memory a mode sized one held for
+// the lifetime of each context.
 struct EGLOffscreenTarget {
     ~EGLOffscreenTarget()
     {
@@ -60,12 +64,12 @@ struct EGLOffscreenTarget {
             gbm_surface_destroy(surface);
     }
 
-    struct gbm_surface* surface;
+    struct gbm_surface* surface { nullptr };
 
-    void initialize(struct gbm_device* device, uint32_t width, uint32_t height)
+    void initialize(struct gbm_device* device)
     {
        if (device)
-           surface = gbm_surface_create(device, width, height, GBM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+           surface = gbm_surface_create(device, 1, 1, GBM_FORMAT_XRGB8888, GBM_BO_USE_RENDERING);
        else{
            DEBUG_PRINT("EGLOffscreenTarget: gbm device is null\n");
            return;
@@ -304,6 +308,8 @@ private:
     const Backend* m_backend;
     struct wl_surface* m_surface;
     struct wl_egl_window* m_window;
+
+    std::unique_ptr<WPE::FrameTimeline> m_timeline { WPE::FrameTimeline::create("Westeros::EGLTarget", WPE::FrameTimeline::Rendered) };
 };
 
 EGLTarget::EGLTarget(struct wpe_renderer_backend_egl_target* target)
@@ -345,12 +351,18 @@ void EGLTarget::resize(uint32_t width, uint32_t height)
 
 void EGLTarget::frameWillRender()
 {
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::WillRender);
+
     struct wl_callback* frameCallback = wl_surface_frame(m_surface);
-    wl_callback_add_listener(frameCallback, &s_frameListener, m_target);
+    wl_callback_add_listener(frameCallback, &s_frameListener, this);
 }
 
 void EGLTarget::frameRendered()
 {
+    if (m_timeline)
+        m_timeline->record(WPE::FrameTimeline::Rendered);
+
     if (m_backend && m_backend->display())
         wl_display_flush(m_backend->display());
 }
@@ -361,8 +373,10 @@ const struct wl_callback_listener EGLTarget::s_frameListener = {
     {
         wl_callback_destroy(callback);
 
-        auto* target = static_cast<struct wpe_renderer_backend_egl_target*>(data);
-        wpe_renderer_backend_egl_target_dispatch_frame_complete(target);
+        auto& target = *static_cast<EGLTarget*>(data);
+        if (target.m_timeline)
+            target.m_timeline->record(WPE::FrameTimeline::FrameComplete);
+        wpe_renderer_backend_egl_target_dispatch_frame_complete(target.m_target);
     },
 };
 
@@ -459,7 +473,7 @@ struct wpe_renderer_backend_egl_offscreen_target_interface westeros_renderer_bac
 #if defined(WPE_BACKEND_MESA)        
         auto* backend = new GBM::Backend;
         auto* target = static_cast<GBM::EGLOffscreenTarget*>(data);
-        target->initialize(backend->device, DEFAULT_MODE_WIDTH, DEFAULT_MODE_HEIGHT);
+        target->initialize(backend->device);
 #endif        
     },
     // get_native_window